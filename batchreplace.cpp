@@ -0,0 +1,179 @@
+#include "batchreplace.hpp"
+#include "textsearch.hpp"
+#include <QFile>
+#include <QObject>
+#include <QtConcurrent>
+#include <algorithm>
+
+bool readReplaceRules(const QString &fileName, QVector<ReplaceRule> *rules, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        *errorString = file.errorString();
+        return false;
+    }
+
+    rules->clear();
+    int lineNumber = 0;
+    while (!file.atEnd()) {
+        ++lineNumber;
+        QString line = QString::fromUtf8(file.readLine());
+        while (line.endsWith(QLatin1Char('\n')) || line.endsWith(QLatin1Char('\r')))
+            line.chop(1);
+        if (line.trimmed().isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        int separator = line.indexOf(QLatin1Char('\t'));
+        int separatorLength = 1;
+        if (separator < 0) {
+            separator = line.indexOf(QLatin1String(" => "));
+            separatorLength = 4;
+        }
+        if (separator <= 0) {
+            *errorString = QObject::tr("Line %1 has no pattern, or no tab or \" => \" after it").arg(lineNumber);
+            return false;
+        }
+        rules->append({line.left(separator), line.mid(separator + separatorLength)});
+    }
+    if (file.error() != QFile::NoError) {
+        *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+static inline ushort foldCase(ushort c)
+{
+    if (c < 0x80)
+        return c >= 'A' && c <= 'Z' ? ushort(c + 32) : c;
+    return QChar(c).toCaseFolded().unicode();
+}
+
+ReplaceAutomaton::ReplaceAutomaton(const QVector<ReplaceRule> &rules, Qt::CaseSensitivity caseSensitivity)
+        : rules(rules), classes(0x10000, 0), classCount(1) {
+    const bool sensitive = caseSensitivity == Qt::CaseSensitive;
+    for (const ReplaceRule &rule : rules) {
+        for (const QChar c : rule.pattern) {
+            const ushort unit = sensitive ? c.unicode() : foldCase(c.unicode());
+            if (!classes.at(unit))
+                classes[unit] = ushort(classCount++);
+        }
+    }
+    // Every unit that folds to a pattern character shares its class
+    if (!sensitive) {
+        for (int unit = 0; unit < 0x10000; ++unit)
+            classes[unit] = classes.at(foldCase(ushort(unit)));
+    }
+
+    // Trie of the patterns, -1 where there is no child yet
+    next.fill(-1, classCount);
+    depth.append(0);
+    rule.append(-1);
+    for (int r = 0; r < rules.size(); ++r) {
+        int state = 0;
+        for (const QChar c : rules.at(r).pattern) {
+            const int index = state * classCount + classes.at(c.unicode());
+            if (next.at(index) < 0) {
+                next[index] = depth.size();
+                next.resize(next.size() + classCount);
+                std::fill(next.end() - classCount, next.end(), -1);
+                depth.append(depth.at(state) + 1);
+                rule.append(-1);
+            }
+            state = next.at(index);
+        }
+        if (state > 0 && rule.at(state) < 0)
+            rule[state] = r;
+    }
+
+    // Breadth first, each missing transition becomes its failure state's
+    QVector<int> failure(depth.size(), 0);
+    dictionary.fill(0, depth.size());
+    QVector<int> queue;
+    queue.reserve(depth.size());
+    for (int c = 0; c < classCount; ++c) {
+        if (next.at(c) < 0)
+            next[c] = 0;
+        else
+            queue.append(next.at(c));
+    }
+    for (int head = 0; head < queue.size(); ++head) {
+        const int state = queue.at(head);
+        const int fail = failure.at(state);
+        dictionary[state] = rule.at(fail) >= 0 ? fail : dictionary.at(fail);
+        for (int c = 0; c < classCount; ++c) {
+            const int index = state * classCount + c;
+            const int child = next.at(index);
+            if (child < 0) {
+                next[index] = next.at(fail * classCount + c);
+            } else {
+                failure[child] = next.at(fail * classCount + c);
+                queue.append(child);
+            }
+        }
+    }
+}
+
+namespace {
+struct Hit
+{
+    int start;
+    int length;
+    int rule;
+};
+}
+
+BatchReplaceResult ReplaceAutomaton::scan(const PieceTable::Snapshot &text, bool wholeWords) const {
+    // Every occurrence of every rule, in one pass over the text
+    QVector<Hit> hits;
+    const int *table = next.constData();
+    const ushort *classOf = classes.constData();
+    int state = 0;
+    for (int position = 0; position < text.length();) {
+        const QChar *data;
+        const int length = text.chunkAt(position, &data);
+        const ushort *units = reinterpret_cast<const ushort *>(data);
+        for (int i = 0; i < length; ++i) {
+            state = table[state * classCount + classOf[units[i]]];
+            int found = rule.at(state) >= 0 ? state : dictionary.at(state);
+            for (; found > 0; found = dictionary.at(found))
+                hits.append({position + i + 1 - depth.at(found), depth.at(found), rule.at(found)});
+        }
+        position += length;
+    }
+
+    // Leftmost first, then longest; an occurrence overlapping one already taken is dropped
+    std::sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) {
+        return a.start != b.start ? a.start < b.start : a.length > b.length;
+    });
+    BatchReplaceResult result;
+    result.hits.fill(0, rules.size());
+    int end = 0;
+    for (const Hit &hit : hits) {
+        if (hit.start < end)
+            continue;
+        if (wholeWords) {
+            const int from = qMax(0, hit.start - 1);
+            const QString around = text.text(from, hit.start + hit.length + 1 - from);
+            const bool before = hit.start > 0 && isWordCharacter(around.at(0));
+            const bool after = hit.start + hit.length < text.length()
+                               && isWordCharacter(around.at(hit.start + hit.length - from));
+            if (before || after)
+                continue;
+        }
+        result.matches.append({hit.start, hit.length, rules.at(hit.rule).replacement});
+        ++result.hits[hit.rule];
+        end = hit.start + hit.length;
+    }
+    return result;
+}
+
+QFuture<BatchReplaceResult> startBatchReplace(const PieceTable &buffer,
+                                              const std::shared_ptr<const ReplaceAutomaton> &automaton,
+                                              bool wholeWords)
+{
+    const PieceTable::Snapshot text = buffer.snapshot();
+    return QtConcurrent::run([=]() {
+        return automaton->scan(text, wholeWords);
+    });
+}
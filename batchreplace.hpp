@@ -0,0 +1,58 @@
+#ifndef BATCHREPLACE_HPP
+#define BATCHREPLACE_HPP
+
+#include <QString>
+#include <QVector>
+#include <QFuture>
+#include <memory>
+#include "piecetable.hpp"
+#include "regexreplace.hpp"
+
+struct ReplaceRule
+{
+    QString pattern;
+    QString replacement;
+};
+
+/* Fichier de règles en UTF-8, une par ligne : « motif<Tab>remplacement » ou
+   « motif => remplacement ». Lignes vides et lignes commençant par # ignorées */
+bool readReplaceRules(const QString &fileName, QVector<ReplaceRule> *rules, QString *errorString);
+
+struct BatchReplaceResult
+{
+    /* Triées, sans chevauchement */
+    QVector<ReplaceMatch> matches;
+    /* Occurrences remplacées par règle, dans l'ordre des règles */
+    QVector<int> hits;
+};
+
+/* Automate d'Aho-Corasick de toutes les règles : le texte est parcouru une seule fois,
+   un caractère = une transition dans une table dense (alphabet réduit aux caractères
+   des motifs). Entre occurrences qui se chevauchent, la plus à gauche puis la plus
+   longue l'emporte ; à motif égal, la première règle */
+class ReplaceAutomaton
+{
+public:
+    ReplaceAutomaton(const QVector<ReplaceRule> &rules, Qt::CaseSensitivity caseSensitivity);
+
+    BatchReplaceResult scan(const PieceTable::Snapshot &text, bool wholeWords) const;
+
+private:
+    QVector<ReplaceRule> rules;
+    /* Classe de chaque unité UTF-16, 0 pour les caractères absents des motifs */
+    QVector<ushort> classes;
+    int classCount;
+    /* Transition de chaque état pour chaque classe, échecs déjà résolus */
+    QVector<int> next;
+    QVector<int> depth;
+    /* Règle reconnue dans l'état, -1 sinon */
+    QVector<int> rule;
+    /* État suivant du chemin d'échec qui reconnaît une règle, 0 sinon */
+    QVector<int> dictionary;
+};
+
+QFuture<BatchReplaceResult> startBatchReplace(const PieceTable &buffer,
+                                              const std::shared_ptr<const ReplaceAutomaton> &automaton,
+                                              bool wholeWords);
+
+#endif
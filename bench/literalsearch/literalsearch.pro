@@ -0,0 +1,25 @@
+TEMPLATE = app
+TARGET = literalsearch-bench
+QT += core concurrent
+QT -= gui
+CONFIG += console release c++14
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../literalsearch.cpp \
+    ../../textsearch.cpp \
+    ../../trigramindex.cpp \
+    ../../piecetable.cpp \
+    ../../wordcount.cpp \
+    ../../cpufeatures.cpp
+
+HEADERS += \
+    ../../literalsearch.hpp \
+    ../../textsearch.hpp \
+    ../../trigramindex.hpp \
+    ../../piecetable.hpp \
+    ../../wordcount.hpp \
+    ../../cpufeatures.hpp
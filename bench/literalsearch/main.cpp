@@ -0,0 +1,136 @@
+#include <QCoreApplication>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <cstdio>
+#include "literalsearch.hpp"
+#include "textsearch.hpp"
+#include "cpufeatures.hpp"
+
+// Counts the occurrences of a few patterns in generated text with LiteralMatcher and with
+// QRegularExpression(escape(pattern)), the search it replaced, case sensitive, case
+// insensitive and whole words. Usage: literalsearch-bench [MB], 64 by default, in
+// megabytes of UTF-16 text.
+
+static const int runs = 3;
+
+/* Words from a small vocabulary, a few capitalised or accented, between spaces and newlines */
+static QString generateText(int characters)
+{
+    static const char *const words[] = { "the", "of", "and", "to", "in", "search", "editor", "document",
+                                         "Needle", "needles", "haystack", "replace", "window", "block" };
+    static const QString accented[] = { QStringLiteral("été"), QStringLiteral("Été"), QStringLiteral("déjà") };
+    QRandomGenerator random(4242);
+    QString text;
+    text.reserve(characters + 16);
+    while (text.size() < characters) {
+        const int pick = random.bounded(100);
+        if (pick < 3)
+            text += accented[pick];
+        else
+            text += QLatin1String(words[random.bounded(int(sizeof(words) / sizeof(words[0])))]);
+        text += random.bounded(12) == 0 ? QLatin1Char('\n') : QLatin1Char(' ');
+    }
+    text.truncate(characters);
+    return text;
+}
+
+static int countLiteral(const QString &text, const LiteralMatcher &matcher, bool wholeWords)
+{
+    const int patternLength = matcher.size();
+    int count = 0;
+    int i = matcher.indexIn(text, 0);
+    while (i >= 0) {
+        if (wholeWords && ((i > 0 && isWordCharacter(text.at(i - 1)))
+                           || (i + patternLength < text.size() && isWordCharacter(text.at(i + patternLength))))) {
+            i = matcher.indexIn(text, i + 1);
+            continue;
+        }
+        ++count;
+        i = matcher.indexIn(text, i + patternLength);
+    }
+    return count;
+}
+
+static int countRegex(const QString &text, const QRegularExpression &regex)
+{
+    int count = 0;
+    QRegularExpressionMatchIterator it = regex.globalMatch(text);
+    while (it.hasNext()) {
+        it.next();
+        ++count;
+    }
+    return count;
+}
+
+// Best of a few runs, in milliseconds
+template <typename Function>
+static double bestOf(const Function &function)
+{
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        QElapsedTimer timer;
+        timer.start();
+        function();
+        const double elapsed = timer.nsecsElapsed() / 1e6;
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const int megabytes = argc > 1 ? QByteArray(argv[1]).toInt() : 64;
+    const QString text = generateText(int(qint64(megabytes) * 1024 * 1024 / 2));
+
+#ifdef OA_X86_SIMD
+    std::printf("%d MB, filter: %s, best of %d runs\n", megabytes, cpuHasAvx2() ? "AVX2" : "SSE2", runs);
+#else
+    std::printf("%d MB, no vector filter, best of %d runs\n", megabytes, runs);
+#endif
+    std::printf("%-14s %-12s %10s %12s %12s %9s\n", "pattern", "mode", "matches", "regex (ms)", "literal (ms)",
+                "speedup");
+
+    const QString patterns[] = { QStringLiteral("needle"), QStringLiteral("the"),
+                                 QStringLiteral("document editor"), QStringLiteral("été"),
+                                 QStringLiteral("xylophone") };
+    struct Mode
+    {
+        const char *name;
+        Qt::CaseSensitivity caseSensitivity;
+        bool wholeWords;
+    };
+    const Mode modes[] = { { "case", Qt::CaseSensitive, false },
+                           { "no case", Qt::CaseInsensitive, false },
+                           { "whole words", Qt::CaseSensitive, true } };
+
+    for (const QString &pattern : patterns) {
+        for (const Mode &mode : modes) {
+            // Unicode properties so that \b and case folding see accented letters as the matcher does
+            QRegularExpression::PatternOptions options = QRegularExpression::UseUnicodePropertiesOption;
+            if (mode.caseSensitivity == Qt::CaseInsensitive)
+                options |= QRegularExpression::CaseInsensitiveOption;
+            QString escaped = QRegularExpression::escape(pattern);
+            if (mode.wholeWords)
+                escaped = QStringLiteral("\\b") + escaped + QStringLiteral("\\b");
+            QRegularExpression regex(escaped, options);
+            regex.optimize();
+            const LiteralMatcher matcher(pattern, mode.caseSensitivity);
+
+            int regexCount = 0;
+            int literalCount = 0;
+            const double regexTime = bestOf([&]() { regexCount = countRegex(text, regex); });
+            const double literalTime = bestOf([&]() { literalCount = countLiteral(text, matcher, mode.wholeWords); });
+            if (regexCount != literalCount) {
+                std::fprintf(stderr, "%s, %s: the regex finds %d matches, the matcher %d\n", qPrintable(pattern),
+                             mode.name, regexCount, literalCount);
+                return 1;
+            }
+            std::printf("%-14s %-12s %10d %12.1f %12.1f %8.1fx\n", qPrintable(pattern), mode.name, literalCount,
+                        regexTime, literalTime, regexTime / literalTime);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <QGuiApplication>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextCharFormat>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QMap>
+#include <cstdio>
+#include "nativeformat.hpp"
+
+// Saves and loads a generated document in the native format (.oad) and through
+// toHtml()/setHtml(), the round trip it replaced. Usage: nativeformat-bench [paragraphs],
+// 100000 by default; QT_QPA_PLATFORM=offscreen runs it without a display.
+
+static const int runs = 3;
+
+static void fillDocument(QTextDocument *document, int paragraphs)
+{
+    QTextCharFormat plain;
+    QTextCharFormat bold;
+    bold.setFontWeight(QFont::Bold);
+    QTextCharFormat italic;
+    italic.setFontItalic(true);
+
+    QTextCursor cursor(document);
+    for (int i = 0; i < paragraphs; ++i) {
+        if (i > 0)
+            cursor.insertBlock();
+        cursor.insertText(QStringLiteral("Paragraph %1 holds a sentence of ordinary words, ").arg(i), plain);
+        cursor.insertText(QStringLiteral("some of them bold"), bold);
+        cursor.insertText(QStringLiteral(", some in italics"), i % 3 == 0 ? italic : plain);
+        cursor.insertText(QStringLiteral(" and the rest plain again."), plain);
+    }
+}
+
+// Best of a few runs, in milliseconds
+template <typename Function>
+static double bestOf(const Function &function)
+{
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        QElapsedTimer timer;
+        timer.start();
+        function();
+        const double elapsed = timer.nsecsElapsed() / 1e6;
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    const int paragraphs = argc > 1 ? QByteArray(argv[1]).toInt() : 100000;
+
+    QTextDocument document;
+    fillDocument(&document, paragraphs);
+    const QMap<int, QString> comments;
+    QString errorString;
+    bool ok = true;
+
+    QByteArray native;
+    const double nativeSave = bestOf([&]() {
+        native.clear();
+        QBuffer buffer(&native);
+        buffer.open(QIODevice::WriteOnly);
+        ok = NativeFormat::write(&buffer, &document, comments, &errorString) && ok;
+    });
+    int nativeBlocks = 0;
+    const double nativeLoad = bestOf([&]() {
+        QBuffer buffer(&native);
+        buffer.open(QIODevice::ReadOnly);
+        QTextDocument loaded;
+        QMap<int, QString> loadedComments;
+        ok = NativeFormat::read(&buffer, &loaded, &loadedComments, &errorString) && ok;
+        nativeBlocks = loaded.blockCount();
+    });
+
+    QString html;
+    const double htmlSave = bestOf([&]() {
+        html = document.toHtml();
+    });
+    int htmlBlocks = 0;
+    const double htmlLoad = bestOf([&]() {
+        QTextDocument loaded;
+        loaded.setHtml(html);
+        htmlBlocks = loaded.blockCount();
+    });
+
+    if (!ok || nativeBlocks != document.blockCount()) {
+        std::fprintf(stderr, "native round trip failed: %s\n", qPrintable(errorString));
+        return 1;
+    }
+
+    std::printf("%d paragraphs, best of %d runs\n", paragraphs, runs);
+    std::printf("%-8s %12s %12s %12s %10s\n", "format", "save (ms)", "load (ms)", "size (KB)", "blocks");
+    std::printf("%-8s %12.1f %12.1f %12d %10d\n", "oad", nativeSave, nativeLoad, native.size() / 1024, nativeBlocks);
+    std::printf("%-8s %12.1f %12.1f %12d %10d\n", "html", htmlSave, htmlLoad, html.toUtf8().size() / 1024,
+                htmlBlocks);
+    std::printf("speedup  %12.1fx %11.1fx\n", htmlSave / nativeSave, htmlLoad / nativeLoad);
+    return 0;
+}
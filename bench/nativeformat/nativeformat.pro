@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = nativeformat-bench
+QT += core gui
+CONFIG += console release c++14
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../nativeformat.cpp
+
+HEADERS += \
+    ../../nativeformat.hpp
@@ -0,0 +1,130 @@
+#include <QGuiApplication>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <cstdio>
+#include "regexreplace.hpp"
+#include "textsearch.hpp"
+#include "piecetable.hpp"
+
+// Times replace-all as the editor does it, a literal scan of the piece table then one
+// edit block, at several document sizes and hit densities. The time per character
+// should stay flat as the document grows. The former loop, one toPlainText() and one
+// regex match per replacement, is run too while it has at most baselineMaxHits hits.
+// Usage: replaceall-bench [lines...], 10000 40000 160000 640000 by default;
+// QT_QPA_PLATFORM=offscreen runs it without a display.
+
+static const int runs = 3;
+static const int baselineMaxHits = 2000;
+static const QString needle = QStringLiteral("needle");
+static const QString replacement = QStringLiteral("pin");
+
+/* Lines of about sixty characters, every every-th one holding the needle */
+static QString generateText(int lines, int every)
+{
+    static const char *const words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+                                         "adipiscing", "elit", "sed", "do", "eiusmod", "tempor" };
+    QString text;
+    text.reserve(lines * 64);
+    for (int line = 0; line < lines; ++line) {
+        for (int word = 0; word < 9; ++word) {
+            if (word)
+                text += QLatin1Char(' ');
+            if (word == 4 && line % every == 0)
+                text += needle;
+            else
+                text += QLatin1String(words[(line * 7 + word * 3) % 12]);
+        }
+        text += QLatin1Char('\n');
+    }
+    return text;
+}
+
+/* The loop replace-all used before the scan */
+static void formerReplaceAll(QTextDocument *document)
+{
+    const QRegularExpression regex(QRegularExpression::escape(needle));
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    while (!cursor.isNull() && !cursor.atEnd()) {
+        const QRegularExpressionMatch match = regex.match(document->toPlainText(), cursor.position());
+        if (!match.hasMatch())
+            break;
+        cursor.setPosition(match.capturedStart());
+        cursor.setPosition(match.capturedEnd(), QTextCursor::KeepAnchor);
+        cursor.insertText(replacement);
+    }
+    cursor.endEditBlock();
+}
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    QList<int> sizes;
+    for (const QString &argument : app.arguments().mid(1))
+        sizes.append(argument.toInt());
+    if (sizes.isEmpty())
+        sizes = { 10000, 40000, 160000, 640000 };
+
+    SearchQuery query;
+    query.pattern = needle;
+    query.caseSensitivity = Qt::CaseSensitive;
+    query.wholeWords = true;
+    const SearchCancel cancel = std::make_shared<QAtomicInt>(0);
+
+    std::printf("best of %d runs\n", runs);
+    std::printf("%8s %10s %8s %10s %10s %10s %10s %9s %12s\n", "lines", "chars", "hits", "scan (ms)",
+                "apply (ms)", "total (ms)", "ns/char", "us/hit", "former (ms)");
+    for (const int every : { 100, 10, 1 }) {
+        for (const int lines : sizes) {
+            const QString text = generateText(lines, every);
+            QString expected = text;
+            expected.replace(needle, replacement);
+
+            double scanTime = 0;
+            double applyTime = 0;
+            int hits = 0;
+            for (int run = 0; run < runs; ++run) {
+                QTextDocument document;
+                document.setUndoRedoEnabled(true);
+                document.setPlainText(text);
+                PieceTable buffer;
+                buffer.setText(text);
+
+                QElapsedTimer timer;
+                timer.start();
+                const ReplaceScan scan = startReplaceScan(buffer, query, replacement, -1, cancel).result();
+                const double scanned = timer.nsecsElapsed() / 1e6;
+                timer.restart();
+                replaceInDocument(QTextCursor(&document), scan.matches);
+                const double applied = timer.nsecsElapsed() / 1e6;
+
+                if (run == 0 && document.toPlainText() != expected) {
+                    std::fprintf(stderr, "%d lines: wrong result\n", lines);
+                    return 1;
+                }
+                if (run == 0 || scanned + applied < scanTime + applyTime) {
+                    scanTime = scanned;
+                    applyTime = applied;
+                }
+                hits = scan.matches.size();
+            }
+
+            const double total = scanTime + applyTime;
+            QByteArray former = "skipped";
+            if (hits <= baselineMaxHits) {
+                QTextDocument document;
+                document.setPlainText(text);
+                QElapsedTimer timer;
+                timer.start();
+                formerReplaceAll(&document);
+                former = QByteArray::number(timer.nsecsElapsed() / 1e6, 'f', 1);
+            }
+            std::printf("%8d %10d %8d %10.1f %10.1f %10.1f %10.2f %9.2f %12s\n", lines, text.size(), hits,
+                        scanTime, applyTime, total, total * 1e6 / text.size(), hits ? total * 1e3 / hits : 0.0,
+                        former.constData());
+        }
+    }
+    return 0;
+}
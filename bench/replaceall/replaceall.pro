@@ -0,0 +1,26 @@
+TEMPLATE = app
+TARGET = replaceall-bench
+QT += core gui concurrent
+CONFIG += console release c++14
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../regexreplace.cpp \
+    ../../textsearch.cpp \
+    ../../trigramindex.cpp \
+    ../../literalsearch.cpp \
+    ../../piecetable.cpp \
+    ../../wordcount.cpp \
+    ../../cpufeatures.cpp
+
+HEADERS += \
+    ../../regexreplace.hpp \
+    ../../textsearch.hpp \
+    ../../trigramindex.hpp \
+    ../../literalsearch.hpp \
+    ../../piecetable.hpp \
+    ../../wordcount.hpp \
+    ../../cpufeatures.hpp
@@ -0,0 +1,100 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <cstdio>
+#include "wordcount.hpp"
+#include "cpufeatures.hpp"
+
+// Counts the words of generated text with countWordStarts() and with the QString::split()
+// call it replaced. Usage: wordcount-bench [MB...], 1 10 100 1000 by default, sizes in
+// megabytes of UTF-16 text. split() builds one QString per word, so it is skipped above
+// splitLimitMB unless --split-all is given.
+
+static const int runs = 3;
+static const int splitLimitMB = 256;
+
+/* Words of one to twelve letters, a few accented, between runs of ASCII whitespace */
+static QString generateText(int characters)
+{
+    static const ushort letters[] = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'l', 'm', 'n', 'o', 'p',
+                                      'r', 's', 't', 'u', 0xe9, 0xe8, 0xe7 };
+    static const char separators[] = { ' ', ' ', ' ', ' ', ' ', ' ', '\n', '\t', '\r' };
+    QRandomGenerator random(12345);
+    QString text(characters, Qt::Uninitialized);
+    ushort *data = reinterpret_cast<ushort *>(text.data());
+    int i = 0;
+    while (i < characters) {
+        for (int n = 1 + random.bounded(12); n > 0 && i < characters; --n)
+            data[i++] = letters[random.bounded(int(sizeof(letters) / sizeof(letters[0])))];
+        for (int n = random.bounded(8) == 0 ? 2 : 1; n > 0 && i < characters; --n)
+            data[i++] = ushort(separators[random.bounded(int(sizeof(separators)))]);
+    }
+    return text;
+}
+
+// Best of a few runs, in milliseconds
+template <typename Function>
+static double bestOf(const Function &function)
+{
+    double best = 0;
+    for (int run = 0; run < runs; ++run) {
+        QElapsedTimer timer;
+        timer.start();
+        function();
+        const double elapsed = timer.nsecsElapsed() / 1e6;
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList arguments = app.arguments().mid(1);
+    const bool splitAll = arguments.removeAll(QStringLiteral("--split-all")) > 0;
+    QList<int> sizes;
+    for (const QString &argument : arguments)
+        sizes.append(argument.toInt());
+    if (sizes.isEmpty())
+        sizes = { 1, 10, 100, 1000 };
+
+#ifdef OA_X86_SIMD
+    std::printf("kernel: %s, best of %d runs\n", cpuHasAvx2() ? "AVX2" : "SSE2", runs);
+#else
+    std::printf("kernel: scalar, best of %d runs\n", runs);
+#endif
+    std::printf("%8s %12s %14s %14s %10s %10s\n", "MB", "words", "split (ms)", "kernel (ms)", "speedup",
+                "GB/s");
+
+    const QRegularExpression separator(QStringLiteral(R"((\s|\n|\r)+)"));
+    for (const int megabytes : sizes) {
+        const QString text = generateText(int(qint64(megabytes) * 1024 * 1024 / 2));
+
+        int words = 0;
+        const double kernel = bestOf([&]() {
+            words = countWordStarts(text.constData(), text.size(), true);
+        });
+
+        const double gigabytesPerSecond = qint64(megabytes) * 1024 * 1024 / (kernel * 1e6);
+        if (megabytes > splitLimitMB && !splitAll) {
+            std::printf("%8d %12d %14s %14.2f %10s %10.2f\n", megabytes, words, "skipped", kernel, "-",
+                        gigabytesPerSecond);
+            continue;
+        }
+
+        int splitWords = 0;
+        const double split = bestOf([&]() {
+            splitWords = text.split(separator, QString::SkipEmptyParts).count();
+        });
+        if (splitWords != words) {
+            std::fprintf(stderr, "%d MB: split counts %d words, the kernel %d\n", megabytes, splitWords, words);
+            return 1;
+        }
+        std::printf("%8d %12d %14.2f %14.2f %9.1fx %10.2f\n", megabytes, words, split, kernel, split / kernel,
+                    gigabytesPerSecond);
+    }
+    return 0;
+}
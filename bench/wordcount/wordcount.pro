@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = wordcount-bench
+QT += core
+QT -= gui
+CONFIG += console release c++14
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../wordcount.cpp \
+    ../../cpufeatures.cpp
+
+HEADERS += \
+    ../../wordcount.hpp \
+    ../../cpufeatures.hpp
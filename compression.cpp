@@ -0,0 +1,327 @@
+#include "compression.hpp"
+#include <QFile>
+#include <QObject>
+#include <QtEndian>
+#include <zlib.h>
+#include <zstd.h>
+#include <cstring>
+
+// Compressed bytes read from the device at once, and compressed bytes produced before a write
+static const int inputChunk = 256 * 1024;
+static const int outputChunk = 256 * 1024;
+// Largest zstd frame header, enough to find the declared content size
+static const int zstdHeaderMax = 18;
+
+Compression compressionForFile(const QString &fileName)
+{
+    if (fileName.endsWith(QLatin1String(".gz"), Qt::CaseInsensitive))
+        return Compression::Gzip;
+    if (fileName.endsWith(QLatin1String(".zst"), Qt::CaseInsensitive))
+        return Compression::Zstd;
+    return Compression::None;
+}
+
+qint64 contentSize(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return 0;
+    const qint64 size = file.size();
+
+    switch (compressionForFile(fileName)) {
+    case Compression::Gzip:
+        // ISIZE closes the last member, modulo 4 GB
+        if (size >= 18 && file.seek(size - 4)) {
+            const QByteArray tail = file.read(4);
+            if (tail.size() == 4)
+                return qMax(size, qint64(qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(tail.constData()))));
+        }
+        break;
+    case Compression::Zstd: {
+        const QByteArray head = file.read(zstdHeaderMax);
+        const unsigned long long declared = ZSTD_getFrameContentSize(head.constData(), size_t(head.size()));
+        if (declared != ZSTD_CONTENTSIZE_UNKNOWN && declared != ZSTD_CONTENTSIZE_ERROR)
+            return qMax(size, qint64(declared));
+        break;
+    }
+    case Compression::None:
+        break;
+    }
+    return size;
+}
+
+struct DecompressingReader::Stream
+{
+    Compression compression;
+    z_stream zlib;
+    ZSTD_DCtx *zstd = nullptr;
+};
+
+DecompressingReader::DecompressingReader(QIODevice *device, Compression compression)
+        : device(device), inputPos(0), bytesRead(0), frameEnded(false), atEnd(false) {
+    if (compression == Compression::None)
+        return;
+
+    stream.reset(new Stream);
+    stream->compression = compression;
+    if (compression == Compression::Gzip) {
+        std::memset(&stream->zlib, 0, sizeof(stream->zlib));
+        // 32 lets zlib recognise both gzip and zlib headers
+        if (inflateInit2(&stream->zlib, 15 + 32) != Z_OK) {
+            stream.reset();
+            fail(QObject::tr("Cannot start decompression"));
+        }
+    } else {
+        stream->zstd = ZSTD_createDCtx();
+        if (!stream->zstd) {
+            stream.reset();
+            fail(QObject::tr("Cannot start decompression"));
+        }
+    }
+}
+
+DecompressingReader::~DecompressingReader() {
+    if (!stream)
+        return;
+    if (stream->compression == Compression::Gzip)
+        inflateEnd(&stream->zlib);
+    else
+        ZSTD_freeDCtx(stream->zstd);
+}
+
+QByteArray DecompressingReader::read(qint64 maxSize) {
+    QByteArray out;
+    if (atEnd || hasError())
+        return out;
+
+    out.resize(int(maxSize));
+    if (!stream) {
+        const qint64 got = device->read(out.data(), maxSize);
+        if (got < 0)
+            fail(device->errorString());
+        atEnd = got <= 0;
+        bytesRead += qMax<qint64>(got, 0);
+        out.resize(int(qMax<qint64>(got, 0)));
+        return out;
+    }
+
+    int produced = 0;
+    while (produced < out.size()) {
+        if (inputPos == input.size() && !fill()) {
+            // An empty file is an empty text, a stream cut inside a frame is damaged
+            if (!hasError() && !frameEnded && bytesRead > 0)
+                fail(QObject::tr("The compressed file is truncated"));
+            atEnd = true;
+            break;
+        }
+
+        const int available = input.size() - inputPos;
+        const int room = out.size() - produced;
+        int consumed;
+        int written;
+        if (stream->compression == Compression::Gzip) {
+            z_stream &zlib = stream->zlib;
+            // Concatenated gzip members decode as one text
+            if (frameEnded)
+                inflateReset(&zlib);
+            zlib.next_in = reinterpret_cast<Bytef *>(input.data() + inputPos);
+            zlib.avail_in = uInt(available);
+            zlib.next_out = reinterpret_cast<Bytef *>(out.data() + produced);
+            zlib.avail_out = uInt(room);
+            const int status = inflate(&zlib, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                fail(QObject::tr("The compressed data is damaged"));
+                break;
+            }
+            consumed = available - int(zlib.avail_in);
+            written = room - int(zlib.avail_out);
+            frameEnded = status == Z_STREAM_END;
+        } else {
+            ZSTD_inBuffer in = { input.constData() + inputPos, size_t(available), 0 };
+            ZSTD_outBuffer o = { out.data() + produced, size_t(room), 0 };
+            const size_t status = ZSTD_decompressStream(stream->zstd, &o, &in);
+            if (ZSTD_isError(status)) {
+                fail(QObject::tr("The compressed data is damaged: %1").arg(QLatin1String(ZSTD_getErrorName(status))));
+                break;
+            }
+            consumed = int(in.pos);
+            written = int(o.pos);
+            // Zero once a frame is decoded and flushed, the next bytes start a new frame
+            frameEnded = status == 0;
+        }
+        inputPos += consumed;
+        produced += written;
+    }
+    out.resize(produced);
+    return out;
+}
+
+// Next block of compressed input, false at the end of the device or on a read error
+bool DecompressingReader::fill() {
+    input.resize(inputChunk);
+    const qint64 got = device->read(input.data(), inputChunk);
+    inputPos = 0;
+    if (got < 0) {
+        input.clear();
+        fail(device->errorString());
+        return false;
+    }
+    input.resize(int(got));
+    bytesRead += got;
+    return got > 0;
+}
+
+void DecompressingReader::fail(const QString &error) {
+    if (lastError.isEmpty())
+        lastError = error;
+    atEnd = true;
+}
+
+bool DecompressingReader::hasError() const {
+    return !lastError.isEmpty();
+}
+
+QString DecompressingReader::errorString() const {
+    return lastError;
+}
+
+qint64 DecompressingReader::compressedBytesRead() const {
+    return bytesRead;
+}
+
+struct CompressingWriter::Stream
+{
+    Compression compression;
+    z_stream zlib;
+    ZSTD_CCtx *zstd = nullptr;
+};
+
+CompressingWriter::CompressingWriter(QIODevice *device, Compression compression)
+        : device(device) {
+    if (compression == Compression::None)
+        return;
+
+    stream.reset(new Stream);
+    stream->compression = compression;
+    output.resize(outputChunk);
+    if (compression == Compression::Gzip) {
+        std::memset(&stream->zlib, 0, sizeof(stream->zlib));
+        // 16 asks for a gzip header and trailer instead of a zlib one
+        if (deflateInit2(&stream->zlib, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            stream.reset();
+            fail(QObject::tr("Cannot start compression"));
+        }
+    } else {
+        stream->zstd = ZSTD_createCCtx();
+        if (!stream->zstd) {
+            stream.reset();
+            fail(QObject::tr("Cannot start compression"));
+            return;
+        }
+        // Lets a multithreaded libzstd compress while the saver encodes the next step;
+        // single-threaded builds refuse the parameter and compress inline
+        ZSTD_CCtx_setParameter(stream->zstd, ZSTD_c_nbWorkers, 2);
+    }
+}
+
+CompressingWriter::~CompressingWriter() {
+    if (!stream)
+        return;
+    if (stream->compression == Compression::Gzip)
+        deflateEnd(&stream->zlib);
+    else
+        ZSTD_freeCCtx(stream->zstd);
+}
+
+bool CompressingWriter::write(const char *data, qint64 length) {
+    if (!lastError.isEmpty())
+        return false;
+    if (!stream) {
+        if (device->write(data, length) != length)
+            return fail(device->errorString());
+        return true;
+    }
+
+    if (stream->compression == Compression::Gzip) {
+        z_stream &zlib = stream->zlib;
+        zlib.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zlib.avail_in = uInt(length);
+        // Input is used up once deflate leaves room in the output
+        do {
+            zlib.next_out = reinterpret_cast<Bytef *>(output.data());
+            zlib.avail_out = uInt(outputChunk);
+            if (deflate(&zlib, Z_NO_FLUSH) == Z_STREAM_ERROR)
+                return fail(QObject::tr("Compression failed"));
+            if (!flushOutput(outputChunk - zlib.avail_out))
+                return false;
+        } while (zlib.avail_out == 0);
+        return true;
+    }
+
+    ZSTD_inBuffer in = { data, size_t(length), 0 };
+    while (in.pos < in.size) {
+        ZSTD_outBuffer o = { output.data(), size_t(outputChunk), 0 };
+        const size_t status = ZSTD_compressStream2(stream->zstd, &o, &in, ZSTD_e_continue);
+        if (ZSTD_isError(status))
+            return fail(QObject::tr("Compression failed: %1").arg(QLatin1String(ZSTD_getErrorName(status))));
+        if (!flushOutput(qint64(o.pos)))
+            return false;
+    }
+    return true;
+}
+
+bool CompressingWriter::write(const QByteArray &bytes) {
+    return write(bytes.constData(), bytes.size());
+}
+
+bool CompressingWriter::finish() {
+    if (!lastError.isEmpty())
+        return false;
+    if (!stream)
+        return true;
+
+    if (stream->compression == Compression::Gzip) {
+        z_stream &zlib = stream->zlib;
+        zlib.next_in = nullptr;
+        zlib.avail_in = 0;
+        int status;
+        do {
+            zlib.next_out = reinterpret_cast<Bytef *>(output.data());
+            zlib.avail_out = uInt(outputChunk);
+            status = deflate(&zlib, Z_FINISH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+                return fail(QObject::tr("Compression failed"));
+            if (!flushOutput(outputChunk - zlib.avail_out))
+                return false;
+        } while (status != Z_STREAM_END);
+        return true;
+    }
+
+    ZSTD_inBuffer in = { nullptr, 0, 0 };
+    size_t remaining;
+    do {
+        ZSTD_outBuffer o = { output.data(), size_t(outputChunk), 0 };
+        remaining = ZSTD_compressStream2(stream->zstd, &o, &in, ZSTD_e_end);
+        if (ZSTD_isError(remaining))
+            return fail(QObject::tr("Compression failed: %1").arg(QLatin1String(ZSTD_getErrorName(remaining))));
+        if (!flushOutput(qint64(o.pos)))
+            return false;
+    } while (remaining != 0);
+    return true;
+}
+
+QString CompressingWriter::errorString() const {
+    return lastError;
+}
+
+bool CompressingWriter::flushOutput(qint64 length) {
+    if (length > 0 && device->write(output.constData(), length) != length)
+        return fail(device->errorString());
+    return true;
+}
+
+bool CompressingWriter::fail(const QString &error) {
+    if (lastError.isEmpty())
+        lastError = error;
+    return false;
+}
@@ -0,0 +1,72 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <QString>
+#include <QByteArray>
+#include <memory>
+
+class QIODevice;
+
+/* Compression transparente, choisie d'après l'extension du fichier */
+enum class Compression { None, Gzip, Zstd };
+
+Compression compressionForFile(const QString &fileName);
+/* Taille du texte une fois décompressé : celle annoncée par le flux (fin gzip, en-tête zstd)
+   quand elle est connue, jamais moins que la taille du fichier */
+qint64 contentSize(const QString &fileName);
+
+/* Décompression en flux : l'entrée est lue par blocs fixes et chaque read() rend au plus
+   maxSize octets, la mémoire reste bornée quel que soit le taux de compression */
+class DecompressingReader
+{
+public:
+    DecompressingReader(QIODevice *device, Compression compression);
+    ~DecompressingReader();
+
+    /* Vide à la fin du flux ou en cas d'erreur (voir errorString) */
+    QByteArray read(qint64 maxSize);
+    bool hasError() const;
+    QString errorString() const;
+    /* Octets lus sur le périphérique, pour la progression */
+    qint64 compressedBytesRead() const;
+
+private:
+    struct Stream;
+    bool fill();
+    void fail(const QString &error);
+
+    QIODevice *const device;
+    std::unique_ptr<Stream> stream;
+    QByteArray input;
+    int inputPos;
+    qint64 bytesRead;
+    bool frameEnded;
+    bool atEnd;
+    QString lastError;
+};
+
+/* Compression en flux vers le périphérique ; sans compression, les octets passent tels quels */
+class CompressingWriter
+{
+public:
+    CompressingWriter(QIODevice *device, Compression compression);
+    ~CompressingWriter();
+
+    bool write(const char *data, qint64 length);
+    bool write(const QByteArray &bytes);
+    /* Termine le flux (fin de trame), à appeler avant de valider le fichier */
+    bool finish();
+    QString errorString() const;
+
+private:
+    struct Stream;
+    bool flushOutput(qint64 length);
+    bool fail(const QString &error);
+
+    QIODevice *const device;
+    std::unique_ptr<Stream> stream;
+    QByteArray output;
+    QString lastError;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include "cpufeatures.hpp"
+#if defined(OA_X86_SIMD) && defined(Q_CC_MSVC)
+#include <intrin.h>
+#endif
+
+static bool detectAvx2()
+{
+#if defined(OA_X86_SIMD) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#elif defined(OA_X86_SIMD) && defined(Q_CC_MSVC)
+    int info[4];
+    __cpuid(info, 1);
+    // AVX itself, and the OS saving the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+    const bool osxsave = info[2] & (1 << 27);
+    const bool avx = info[2] & (1 << 28);
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return false;
+#endif
+}
+
+bool cpuHasAvx2()
+{
+    static const bool avx2 = detectAvx2();
+    return avx2;
+}
@@ -0,0 +1,19 @@
+#ifndef CPUFEATURES_HPP
+#define CPUFEATURES_HPP
+
+#include <QtGlobal>
+
+/* Noyaux vectoriels : SSE2 fait partie de x86-64, AVX2 est choisi à l'exécution */
+#if defined(Q_PROCESSOR_X86_64) || (defined(Q_PROCESSOR_X86) && defined(__SSE2__))
+#  define OA_X86_SIMD 1
+#  if defined(Q_CC_GNU) || defined(Q_CC_CLANG)
+#    define OA_TARGET_AVX2 __attribute__((target("avx2")))
+#  else
+#    define OA_TARGET_AVX2
+#  endif
+#endif
+
+/* Vrai si le processeur et le système permettent d'utiliser AVX2 */
+bool cpuHasAvx2();
+
+#endif
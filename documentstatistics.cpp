@@ -0,0 +1,156 @@
+#include "documentstatistics.hpp"
+#include "wordcount.hpp"
+#include <QtConcurrent>
+#include <QThread>
+#include <algorithm>
+
+// Paragraphs listed in the panel, and the characters counted per task
+static const int longestParagraphCount = 5;
+static const int sliceChars = 1024 * 1024;
+static const double wordsPerMinute = 200;
+
+struct StatisticsSlice
+{
+    PieceTable::Snapshot snapshot;
+    int start;
+    int length;
+    int firstLine;
+};
+
+double DocumentStatistics::averageSentenceLength() const
+{
+    return sentences > 0 ? double(sentenceWords) / sentences : 0;
+}
+
+double DocumentStatistics::readingMinutes() const
+{
+    return words / wordsPerMinute;
+}
+
+static void keepLongest(QVector<DocumentStatistics::Paragraph> *longest, const DocumentStatistics::Paragraph &paragraph)
+{
+    if (longest->size() == longestParagraphCount && longest->last().words >= paragraph.words)
+        return;
+    auto it = std::upper_bound(longest->begin(), longest->end(), paragraph,
+                               [](const DocumentStatistics::Paragraph &a, const DocumentStatistics::Paragraph &b) {
+                                   return a.words > b.words;
+                               });
+    longest->insert(it, paragraph);
+    if (longest->size() > longestParagraphCount)
+        longest->removeLast();
+}
+
+static bool isClosing(QChar c)
+{
+    const ushort u = c.unicode();
+    return u == '"' || u == '\'' || u == ')' || u == ']' || u == 0x00bb || u == 0x2019 || u == 0x201d;
+}
+
+static bool endsSentence(const QChar *begin, const QChar *end)
+{
+    while (end > begin && isClosing(end[-1]))
+        --end;
+    if (end == begin)
+        return false;
+    const ushort last = end[-1].unicode();
+    return last == '.' || last == '!' || last == '?' || last == 0x2026;
+}
+
+static DocumentStatistics sliceStatistics(const StatisticsSlice &slice)
+{
+    DocumentStatistics stats;
+    const QString text = slice.snapshot.text(slice.start, slice.length);
+    const QChar *p = text.constData();
+    const QChar *const end = p + text.size();
+    int line = slice.firstLine;
+    int paragraphWords = 0;
+    int sentenceWords = 0;
+
+    // The slice starts on a line and ends after a '\n' or at the end of the text,
+    // so every paragraph, and therefore every sentence, lies in a single slice
+    for (;;) {
+        if (p == end || *p == QLatin1Char('\n')) {
+            if (sentenceWords > 0) {
+                ++stats.sentences;
+                stats.sentenceWords += sentenceWords;
+                sentenceWords = 0;
+            }
+            if (paragraphWords > 0) {
+                ++stats.paragraphs;
+                keepLongest(&stats.longestParagraphs, {line, paragraphWords});
+                paragraphWords = 0;
+            }
+            if (p == end)
+                break;
+            ++line;
+            ++p;
+            continue;
+        }
+        if (isAsciiSpace(p->unicode())) {
+            ++p;
+            continue;
+        }
+
+        const QChar *const wordStart = p;
+        while (p < end && !isAsciiSpace(p->unicode()))
+            ++p;
+        ++stats.words;
+        ++paragraphWords;
+        ++sentenceWords;
+        if (endsSentence(wordStart, p)) {
+            ++stats.sentences;
+            stats.sentenceWords += sentenceWords;
+            sentenceWords = 0;
+        }
+
+        const QChar *first = wordStart;
+        const QChar *last = p;
+        while (first < last && !first->isLetterOrNumber())
+            ++first;
+        while (last > first && !last[-1].isLetterOrNumber())
+            --last;
+        if (first < last)
+            stats.vocabulary.insert(QString(first, int(last - first)).toCaseFolded());
+    }
+    return stats;
+}
+
+static void mergeStatistics(DocumentStatistics &total, const DocumentStatistics &part)
+{
+    total.words += part.words;
+    total.sentences += part.sentences;
+    total.sentenceWords += part.sentenceWords;
+    total.paragraphs += part.paragraphs;
+    for (const DocumentStatistics::Paragraph &paragraph : part.longestParagraphs)
+        keepLongest(&total.longestParagraphs, paragraph);
+    total.vocabulary.unite(part.vocabulary);
+}
+
+QFuture<DocumentStatistics> computeStatistics(const PieceTable &buffer)
+{
+    // Enough slices to keep every core busy, each starting on a line boundary
+    const int length = buffer.length();
+    const int sliceCount = qMax(1, qMin(length / sliceChars + 1, QThread::idealThreadCount() * 8));
+    const PieceTable::Snapshot snapshot = buffer.snapshot();
+
+    QVector<StatisticsSlice> slices;
+    int start = 0;
+    int line = 0;
+    for (int i = 1; i <= sliceCount; ++i) {
+        int next = length;
+        int nextLine = 0;
+        if (i < sliceCount) {
+            nextLine = buffer.lineAt(int(qint64(length) * i / sliceCount));
+            next = buffer.lineStart(nextLine);
+        }
+        if (next <= start)
+            continue;
+        slices.append({snapshot, start, next - start, line});
+        start = next;
+        line = nextLine;
+    }
+    if (slices.isEmpty())
+        slices.append({snapshot, 0, 0, 0});
+
+    return QtConcurrent::mappedReduced<DocumentStatistics>(slices, sliceStatistics, mergeStatistics);
+}
@@ -0,0 +1,39 @@
+#ifndef DOCUMENTSTATISTICS_HPP
+#define DOCUMENTSTATISTICS_HPP
+
+#include <QVector>
+#include <QSet>
+#include <QString>
+#include <QFuture>
+#include "piecetable.hpp"
+
+/* Statistiques du texte entier pour le panneau Statistiques. Mots : séparés par des
+   blancs ASCII comme dans la barre d'état ; phrase : se termine par . ! ? ou … ou
+   par la fin du paragraphe ; paragraphe : ligne qui contient au moins un mot */
+struct DocumentStatistics
+{
+    struct Paragraph
+    {
+        int line;
+        int words;
+    };
+
+    qint64 words = 0;
+    qint64 sentences = 0;
+    qint64 sentenceWords = 0;
+    qint64 paragraphs = 0;
+    /* Les plus longs d'abord */
+    QVector<Paragraph> longestParagraphs;
+    /* Mots sans la ponctuation qui les entoure, en casse repliée */
+    QSet<QString> vocabulary;
+
+    double averageSentenceLength() const;
+    /* À 200 mots par minute */
+    double readingMinutes() const;
+};
+
+/* Le texte est découpé en tranches alignées sur les lignes, comptées en parallèle par
+   QtConcurrent::mappedReduced sur un instantané : le thread graphique ne fait que le découpage */
+QFuture<DocumentStatistics> computeStatistics(const PieceTable &buffer);
+
+#endif
@@ -0,0 +1,485 @@
+#include "editjournal.hpp"
+#include "fileloader.hpp"
+#include "nativeformat.hpp"
+#include <QTextDocument>
+#include <QCoreApplication>
+#include <QTimer>
+#include <QFile>
+#include <QSaveFile>
+#include <QLockFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QDir>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <cstring>
+#include <vector>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Identifies journal files and the layout of their records
+static const quint32 journalMagic = 0x4f414a32; // "OAJ2"
+static const quint32 frameMagic = 0x46524d31;   // "FRM1"
+// Without typing for this long, journaled changes are folded into the document file
+static const int idleThresholdMs = 2 * 60 * 1000;
+// Edits are written and synced to disk in groups, at most this long after they happen
+static const int commitIntervalMs = 1000;
+
+/* Every flush appends one frame holding the records typed since the previous one.
+   A frame cut short by a crash fails its checksum and ends the replay there.
+   Records are (position, removed, added length) followed by the added UTF-16
+   text, in native byte order since journals never leave the machine. */
+struct FrameHeader
+{
+    quint32 magic;
+    quint32 length;
+    quint32 checksum;
+};
+
+static bool syncToDisk(QFile *file)
+{
+#if defined(Q_OS_WIN)
+    return _commit(file->handle()) == 0;
+#elif defined(Q_OS_LINUX)
+    return ::fdatasync(file->handle()) == 0;
+#else
+    return ::fsync(file->handle()) == 0;
+#endif
+}
+
+static QString journalPathFor(const QString &documentFile, int instance)
+{
+    // Each window has a journal of its own for its untitled document
+    const QString name = documentFile.isEmpty()
+            ? QStringLiteral("untitled-%1-%2").arg(QCoreApplication::applicationPid()).arg(instance)
+            : QString::fromLatin1(QCryptographicHash::hash(QFileInfo(documentFile).absoluteFilePath().toUtf8(),
+                                                           QCryptographicHash::Md5).toHex());
+    return EditJournal::recoveryDirectory() + QLatin1Char('/') + name + QStringLiteral(".journal");
+}
+
+static qint64 readHeader(QIODevice *device, QString *documentFile, qint64 *baseSize, qint64 *baseModified)
+{
+    QDataStream in(device);
+    quint32 magic = 0;
+    in >> magic;
+    if (magic != journalMagic)
+        return -1;
+    in >> *baseSize >> *baseModified >> *documentFile;
+    if (in.status() != QDataStream::Ok)
+        return -1;
+    return device->pos();
+}
+
+/* Replay target: edits cluster around the caret, so moving the gap is cheap */
+class GapBuffer
+{
+public:
+    explicit GapBuffer(const QString &text)
+            : storage(size_t(text.size()) + minGap), gapStart(text.size()), gapEnd(int(storage.size())) {
+        std::memcpy(storage.data(), text.constData(), size_t(text.size()) * sizeof(QChar));
+    }
+
+    int size() const {
+        return int(storage.size()) - (gapEnd - gapStart);
+    }
+
+    void replace(int position, int removed, const QChar *added, int count) {
+        position = qBound(0, position, size());
+        removed = qBound(0, removed, size() - position);
+        moveGap(position);
+        gapEnd += removed;
+        reserveGap(count);
+        std::memcpy(storage.data() + gapStart, added, size_t(count) * sizeof(QChar));
+        gapStart += count;
+    }
+
+    QString text() const {
+        QString result;
+        result.reserve(size());
+        result.append(storage.data(), gapStart);
+        result.append(storage.data() + gapEnd, int(storage.size()) - gapEnd);
+        return result;
+    }
+
+private:
+    static const int minGap = 64 * 1024;
+
+    void moveGap(int position) {
+        if (position < gapStart) {
+            const int count = gapStart - position;
+            std::memmove(storage.data() + gapEnd - count, storage.data() + position, size_t(count) * sizeof(QChar));
+            gapStart -= count;
+            gapEnd -= count;
+        } else if (position > gapStart) {
+            const int count = position - gapStart;
+            std::memmove(storage.data() + gapStart, storage.data() + gapEnd, size_t(count) * sizeof(QChar));
+            gapStart += count;
+            gapEnd += count;
+        }
+    }
+
+    void reserveGap(int count) {
+        if (gapEnd - gapStart >= count)
+            return;
+        const size_t tail = storage.size() - size_t(gapEnd);
+        std::vector<QChar> grown(qMax(storage.size() * 2, storage.size() + size_t(count) + minGap));
+        std::memcpy(grown.data(), storage.data(), size_t(gapStart) * sizeof(QChar));
+        std::memcpy(grown.data() + grown.size() - tail, storage.data() + gapEnd, tail * sizeof(QChar));
+        gapEnd = int(grown.size() - tail);
+        storage.swap(grown);
+    }
+
+    std::vector<QChar> storage;
+    int gapStart;
+    int gapEnd;
+};
+
+EditJournal::EditJournal(QObject *parent)
+        : QObject(parent), idleTimer(new QTimer(this)), commitTimer(new QTimer(this)),
+          journal(nullptr), lock(nullptr), headerBytes(0), dirty(false) {
+    static int instances = 0;
+    instance = ++instances;
+    journalFile = journalPathFor(QString(), instance);
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(idleThresholdMs);
+    connect(idleTimer, &QTimer::timeout, this, &EditJournal::idleTimeout);
+    commitTimer->setSingleShot(true);
+    commitTimer->setInterval(commitIntervalMs);
+    connect(commitTimer, &QTimer::timeout, this, &EditJournal::flush);
+}
+
+EditJournal::~EditJournal() {
+    // Unsaved edits stay recoverable unless discard() was called on a clean close
+    flush();
+    delete journal;
+    delete lock;
+}
+
+QString EditJournal::recoveryDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + QStringLiteral("/recovery");
+}
+
+void EditJournal::setFileName(const QString &file) {
+    // Saving under this name keeps the journal until the write is known to have succeeded
+    if (!compactionMarkers.isEmpty() && compactionMarkers.last().documentFile == file)
+        return;
+
+    // Another document was loaded or started, the journal of the previous one is obsolete
+    discard();
+    documentFile = file;
+    baseFile = file;
+    journalFile = journalPathFor(file, instance);
+}
+
+bool EditJournal::adopt(const QString &file, const QString &documentFile, qint64 validBytes) {
+    discard();
+    this->documentFile = documentFile;
+    baseFile = documentFile;
+    journalFile = file;
+
+    lock = new QLockFile(journalFile + QStringLiteral(".lock"));
+    if (!lock->tryLock(0)) {
+        delete lock;
+        lock = nullptr;
+        journalFile = journalPathFor(documentFile, instance);
+        return false;
+    }
+
+    // The torn tail left by the crash is cut before new frames are appended
+    QString recordedFile;
+    qint64 baseSize, baseModified;
+    headerBytes = -1;
+    journal = new QFile(journalFile);
+    if (journal->open(QFile::ReadOnly))
+        headerBytes = readHeader(journal, &recordedFile, &baseSize, &baseModified);
+    journal->close();
+    if (headerBytes < 0 || !journal->resize(validBytes) || !journal->open(QFile::WriteOnly | QFile::Append)) {
+        closeJournal();
+        return false;
+    }
+    dirty = true;
+    return true;
+}
+
+void EditJournal::discard() {
+    closeJournal();
+    pending.clear();
+    compactionMarkers.clear();
+    dirty = false;
+    commitTimer->stop();
+    idleTimer->stop();
+}
+
+bool EditJournal::hasChanges() const {
+    return dirty;
+}
+
+void EditJournal::recordChange(int position, int charsRemoved, const QString &added) {
+    const qint32 record[3] = { qint32(position), qint32(charsRemoved), qint32(added.size()) };
+    pending.append(reinterpret_cast<const char *>(record), sizeof(record));
+    pending.append(reinterpret_cast<const char *>(added.constData()), added.size() * int(sizeof(QChar)));
+
+    dirty = true;
+    idleTimer->start();
+    if (!commitTimer->isActive())
+        commitTimer->start();
+}
+
+bool EditJournal::openJournal() {
+    if (journal)
+        return true;
+
+    QDir().mkpath(recoveryDirectory());
+    lock = new QLockFile(journalFile + QStringLiteral(".lock"));
+    if (!lock->tryLock(0)) {
+        // Another instance is editing the same file, keep a journal of our own
+        delete lock;
+        journalFile.insert(journalFile.lastIndexOf(QLatin1Char('.')),
+                           QStringLiteral("-%1").arg(QCoreApplication::applicationPid()));
+        lock = new QLockFile(journalFile + QStringLiteral(".lock"));
+        if (!lock->tryLock(0)) {
+            delete lock;
+            lock = nullptr;
+            return false;
+        }
+    }
+
+    journal = new QFile(journalFile);
+    if (!journal->open(QFile::WriteOnly | QFile::Truncate) || !writeHeader(journal)) {
+        closeJournal();
+        return false;
+    }
+    headerBytes = journal->pos();
+    return true;
+}
+
+void EditJournal::closeJournal() {
+    if (journal) {
+        journal->close();
+        QFile::remove(journalFile);
+        delete journal;
+        journal = nullptr;
+    }
+    delete lock;
+    lock = nullptr;
+    headerBytes = 0;
+}
+
+bool EditJournal::flush() {
+    commitTimer->stop();
+    if (pending.isEmpty())
+        return true;
+    if (!openJournal())
+        return false;
+
+    FrameHeader frame;
+    frame.magic = frameMagic;
+    frame.length = quint32(pending.size());
+    frame.checksum = qChecksum(pending.constData(), uint(pending.size()));
+
+    QByteArray bytes;
+    bytes.reserve(int(sizeof(frame)) + pending.size());
+    bytes.append(reinterpret_cast<const char *>(&frame), sizeof(frame));
+    bytes.append(pending);
+
+    // One sync per frame keeps the cost per keystroke close to nothing
+    const qint64 end = journal->size();
+    if (journal->write(bytes) != bytes.size() || !journal->flush() || !syncToDisk(journal)) {
+        journal->resize(end);
+        return false;
+    }
+    pending.clear();
+    return true;
+}
+
+qint64 EditJournal::recordsStart(qint64 marker) const {
+    return marker < 0 ? headerBytes : marker;
+}
+
+void EditJournal::beginCompaction(const QString &file) {
+    // Everything up to the snapshot reaches the journal before the snapshot is written
+    flush();
+    compactionMarkers.append({journal ? journal->size() : -1, file});
+    documentFile = file;
+    idleTimer->stop();
+}
+
+void EditJournal::endCompaction(const QString &file, bool ok) {
+    if (compactionMarkers.isEmpty() || file != compactionMarkers.first().documentFile)
+        return;
+
+    // Saves run one after the other and only the newest request becomes the base: the
+    // markers of the saves waiting in between are dropped, and so ignored when they finish
+    const qint64 marker = compactionMarkers.takeFirst().offset;
+    while (compactionMarkers.size() > 1)
+        compactionMarkers.removeFirst();
+    // A failed write leaves the journal replaying onto the file it was based on
+    if (!ok)
+        return;
+
+    // The saved file is the new base. A journal rewritten in place keeps its name
+    // until it is next emptied, the header records the base anyway
+    baseFile = file;
+    if (!journal) {
+        journalFile = journalPathFor(baseFile, instance);
+        dirty = !pending.isEmpty();
+        return;
+    }
+
+    // Frames written while the document was being saved belong to the new base
+    const qint64 start = recordsStart(marker);
+    QByteArray tail;
+    journal->close();
+    if (journal->open(QFile::ReadOnly) && journal->seek(start))
+        tail = journal->readAll();
+    journal->close();
+
+    if (tail.isEmpty()) {
+        closeJournal();
+        journalFile = journalPathFor(baseFile, instance);
+        if (!compactionMarkers.isEmpty())
+            compactionMarkers.first().offset = -1;
+        dirty = !pending.isEmpty();
+        return;
+    }
+
+    QSaveFile rewritten(journalFile);
+    qint64 newHeaderBytes = -1;
+    if (rewritten.open(QFile::WriteOnly) && writeHeader(&rewritten)) {
+        newHeaderBytes = rewritten.pos();
+        if (rewritten.write(tail) != tail.size() || !rewritten.commit())
+            newHeaderBytes = -1;
+    }
+    if (newHeaderBytes < 0 || !journal->open(QFile::WriteOnly | QFile::Append)) {
+        // Start over against the new base with the unframed records
+        QByteArray records;
+        for (qint64 offset = 0; offset + qint64(sizeof(FrameHeader)) <= tail.size();) {
+            FrameHeader frame;
+            std::memcpy(&frame, tail.constData() + offset, sizeof(frame));
+            records.append(tail.constData() + offset + sizeof(frame), int(frame.length));
+            offset += qint64(sizeof(frame)) + frame.length;
+        }
+        closeJournal();
+        journalFile = journalPathFor(baseFile, instance);
+        pending.prepend(records);
+        compactionMarkers.clear();
+        dirty = true;
+        return;
+    }
+
+    if (!compactionMarkers.isEmpty() && compactionMarkers.first().offset >= 0)
+        compactionMarkers.first().offset = newHeaderBytes + (compactionMarkers.first().offset - start);
+    headerBytes = newHeaderBytes;
+    dirty = true;
+}
+
+void EditJournal::idleTimeout() {
+    if (dirty && !documentFile.isEmpty())
+        emit idle();
+}
+
+bool EditJournal::writeHeader(QIODevice *device) const {
+    const QFileInfo info(baseFile);
+    QDataStream out(device);
+    out << journalMagic << qint64(info.size()) << qint64(info.lastModified().toMSecsSinceEpoch()) << baseFile;
+    return out.status() == QDataStream::Ok;
+}
+
+QStringList EditJournal::orphanedJournals() {
+    QStringList journals;
+    const QFileInfoList files = QDir(recoveryDirectory()).entryInfoList(QStringList() << QStringLiteral("*.journal"),
+                                                                         QDir::Files, QDir::Time);
+    for (const QFileInfo &info : files) {
+        // Live instances hold the lock, a crashed one leaves it stale
+        QLockFile lock(info.filePath() + QStringLiteral(".lock"));
+        if (lock.tryLock(0)) {
+            lock.unlock();
+            journals.append(info.filePath());
+        }
+    }
+    return journals;
+}
+
+bool EditJournal::replay(const QString &journalFile, JournalReplay *result, QString *errorString) {
+    QFile file(journalFile);
+    if (!file.open(QFile::ReadOnly)) {
+        *errorString = file.errorString();
+        return false;
+    }
+
+    qint64 baseSize, baseModified;
+    const qint64 start = readHeader(&file, &result->documentFile, &baseSize, &baseModified);
+    if (start < 0) {
+        *errorString = tr("Not a journal file");
+        return false;
+    }
+
+    QString base;
+    if (!result->documentFile.isEmpty()) {
+        const QFileInfo info(result->documentFile);
+        if (!info.exists() || info.size() != baseSize || info.lastModified().toMSecsSinceEpoch() != baseModified) {
+            *errorString = tr("%1 was changed after the journal was started")
+                    .arg(QDir::toNativeSeparators(result->documentFile));
+            return false;
+        }
+        if (NativeFormat::isNativeFile(result->documentFile)) {
+            // Journal positions count the frame and block markers that toPlainText keeps
+            QFile native(result->documentFile);
+            QTextDocument document;
+            QMap<int, QString> comments;
+            if (!native.open(QFile::ReadOnly)) {
+                *errorString = native.errorString();
+                return false;
+            }
+            if (!NativeFormat::read(&native, &document, &comments, errorString))
+                return false;
+            base = document.toPlainText();
+        } else if (!FileLoader::readAll(result->documentFile, &base, errorString, &result->format)) {
+            return false;
+        }
+    }
+
+    const qint64 size = file.size();
+    const uchar *mapped = file.map(0, size);
+    QByteArray buffer;
+    if (!mapped && file.seek(0))
+        buffer = file.readAll();
+    const char *data = mapped ? reinterpret_cast<const char *>(mapped) : buffer.constData();
+
+    GapBuffer text(base);
+    base = QString();
+    qint64 offset = start;
+    qint64 operations = 0;
+    while (size - offset >= qint64(sizeof(FrameHeader))) {
+        FrameHeader frame;
+        std::memcpy(&frame, data + offset, sizeof(frame));
+        const char *payload = data + offset + sizeof(frame);
+        if (frame.magic != frameMagic || frame.length > quint64(size - offset) - sizeof(frame)
+            || qChecksum(payload, frame.length) != frame.checksum)
+            break;
+
+        const char *p = payload;
+        const char *const end = payload + frame.length;
+        while (end - p >= qint64(3 * sizeof(qint32))) {
+            qint32 record[3];
+            std::memcpy(record, p, sizeof(record));
+            p += sizeof(record);
+            const qint64 addedBytes = qint64(record[2]) * qint64(sizeof(QChar));
+            if (record[2] < 0 || end - p < addedBytes)
+                break;
+            text.replace(record[0], record[1], reinterpret_cast<const QChar *>(p), record[2]);
+            p += addedBytes;
+            ++operations;
+        }
+        offset += qint64(sizeof(frame)) + frame.length;
+    }
+
+    result->text = text.text();
+    result->validBytes = offset;
+    result->operations = operations;
+    return true;
+}
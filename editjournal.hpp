@@ -0,0 +1,99 @@
+#ifndef EDITJOURNAL_HPP
+#define EDITJOURNAL_HPP
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include "textencoding.hpp"
+
+class QTimer;
+class QFile;
+class QLockFile;
+
+/* Résultat du rejeu d'un journal sur son fichier de base */
+struct JournalReplay
+{
+    QString documentFile;
+    QString text;
+    /* Encodage et fin de ligne du fichier de base, à garder à l'enregistrement */
+    TextFileFormat format;
+    qint64 validBytes = 0;
+    qint64 operations = 0;
+};
+
+/* Journal des modifications (write-ahead log) : chaque modification du texte est ajoutée à
+   un fichier de récupération, synchronisé sur disque par lots, au lieu de réécrire
+   tout le document à chaque sauvegarde automatique */
+class EditJournal : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit EditJournal(QObject *parent = nullptr);
+    ~EditJournal() override;
+
+    /* Nouveau document : le journal précédent est supprimé, sauf pendant l'enregistrement
+       sous ce nom commencé par beginCompaction */
+    void setFileName(const QString &documentFile);
+    /* Reprendre un journal restauré au démarrage, les nouvelles opérations s'y ajoutent */
+    bool adopt(const QString &journalFile, const QString &documentFile, qint64 validBytes);
+    /* Supprimer le journal, le document a été enregistré ou abandonné */
+    void discard();
+    bool hasChanges() const;
+    /* Ajouter les modifications en attente au journal puis le synchroniser sur disque */
+    bool flush();
+
+    /* Compaction : le document est réécrit en entier dans documentFile, puis le journal
+       repart de zéro sur ce fichier. Jusque-là, même pour « Enregistrer sous », le journal
+       reste celui du fichier de base : un échec ou un arrêt brutal ne perd rien */
+    void beginCompaction(const QString &documentFile);
+    void endCompaction(const QString &documentFile, bool ok);
+
+    static QString recoveryDirectory();
+    /* Journaux laissés par une instance arrêtée sans les avoir supprimés */
+    static QStringList orphanedJournals();
+    static bool replay(const QString &journalFile, JournalReplay *result, QString *errorString);
+
+public slots:
+    /* Modification du texte brut, en positions du document entier */
+    void recordChange(int position, int charsRemoved, const QString &added);
+
+signals:
+    /* Plus aucune frappe depuis le seuil d'inactivité alors que le journal n'est pas vide */
+    void idle();
+
+private slots:
+    void idleTimeout();
+
+private:
+    bool openJournal();
+    void closeJournal();
+    bool writeHeader(QIODevice *device) const;
+    qint64 recordsStart(qint64 marker) const;
+
+    QTimer *idleTimer;
+    QTimer *commitTimer;
+    /* Fichier où le document sera enregistré, et fichier sur lequel le journal se rejoue */
+    QString documentFile;
+    QString baseFile;
+    QString journalFile;
+    QFile *journal;
+    QLockFile *lock;
+    qint64 headerBytes;
+    QByteArray pending;
+    /* Numéro du journal dans le processus, pour nommer celui d'un document sans titre */
+    int instance;
+    /* Position dans le journal de chaque instantané en cours d'écriture (-1 avant le premier
+       enregistrement) et fichier où il est écrit */
+    struct CompactionMarker
+    {
+        qint64 offset;
+        QString documentFile;
+    };
+    QList<CompactionMarker> compactionMarkers;
+    bool dirty;
+};
+
+#endif
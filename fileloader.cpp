@@ -0,0 +1,581 @@
+#include "fileloader.hpp"
+#include "textencoding.hpp"
+#include "compression.hpp"
+#include "piecetable.hpp"
+#include <QFile>
+#include <QTextCodec>
+#include <QTextDocument>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <memory>
+#include <limits>
+
+// Bytes decoded per step; the first step is small so the first screen shows up at once
+static const qint64 firstChunkSize = 64 * 1024;
+static const qint64 chunkSize = 4 * 1024 * 1024;
+// Characters handed to the GUI thread at once, and how many batches may wait
+static const int batchChars = 64 * 1024;
+static const int maxQueuedBatches = 64;
+// Chunks read ahead of the decoder when the file cannot be mapped
+static const int maxQueuedChunks = 2;
+// Time the GUI thread spends inserting batches before returning to the event loop
+static const int feedBudgetMs = 8;
+// Longest text a load may produce, the text edit and its piece table hold no more
+static const qint64 maxTextLength = PieceTable::maxLength;
+
+static QString tooLargeError()
+{
+    return FileLoader::tr("The file is too large to be opened (more than %L1 characters)").arg(maxTextLength);
+}
+
+/* Characters that content bytes starting with head may decode to at most: one per byte,
+   one per two bytes in UTF-16. UTF-8 is counted as one per byte too, the only bound
+   known before decoding, so a file is refused rather than decoded past the limit. */
+static qint64 decodedLengthBound(const QByteArray &head, qint64 contentBytes)
+{
+    TextFileFormat format;
+    detectEncoding(head.constData(), head.size(), &format);
+    const bool utf16 = format.encoding == TextFileFormat::Utf16LE || format.encoding == TextFileFormat::Utf16BE;
+    return utf16 ? contentBytes / 2 : contentBytes;
+}
+
+struct LoadBatch
+{
+    QString text;
+    qint64 bytesEnd = 0;
+    qint64 lines = 0;
+    /* The text handed over so far is dropped, the file is read again from the start */
+    bool restart = false;
+};
+
+/* Reads the file, inflating it when compressed, a couple of chunks ahead of the
+   decoder, so that reading and decompression overlap with decoding */
+class ReadAheadWorker : public QThread
+{
+public:
+    ReadAheadWorker(QIODevice *device, Compression compression)
+            : reader(device, compression) {}
+
+    /* Blocks until the next chunk is ready, false at the end of the file */
+    bool take(QByteArray &chunk, qint64 &bytesEnd) {
+        QMutexLocker locker(&mutex);
+        while (chunks.isEmpty() && !done)
+            notEmpty.wait(&mutex);
+        if (chunks.isEmpty())
+            return false;
+        chunk = chunks.dequeue();
+        bytesEnd = chunkEnds.dequeue();
+        notFull.wakeOne();
+        return true;
+    }
+
+    QString error() {
+        QMutexLocker locker(&mutex);
+        return errorString;
+    }
+
+    void requestCancel() {
+        cancelled.storeRelease(1);
+        QMutexLocker locker(&mutex);
+        notFull.wakeAll();
+    }
+
+protected:
+    void run() override {
+        qint64 step = firstChunkSize;
+        while (!cancelled.loadAcquire()) {
+            const QByteArray chunk = reader.read(step);
+            step = chunkSize;
+            if (chunk.isEmpty())
+                break;
+            QMutexLocker locker(&mutex);
+            while (chunks.size() >= maxQueuedChunks && !cancelled.loadAcquire())
+                notFull.wait(&mutex);
+            chunks.enqueue(chunk);
+            chunkEnds.enqueue(reader.compressedBytesRead());
+            notEmpty.wakeOne();
+        }
+        QMutexLocker locker(&mutex);
+        done = true;
+        errorString = reader.errorString();
+        notEmpty.wakeAll();
+    }
+
+private:
+    DecompressingReader reader;
+    QAtomicInt cancelled;
+
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    QQueue<QByteArray> chunks;
+    QQueue<qint64> chunkEnds;
+    bool done = false;
+    QString errorString;
+};
+
+/* Decodes the file and cuts it into line-aligned batches on its own thread */
+class LoadWorker : public QThread
+{
+public:
+    LoadWorker(const QString &fileName, QTimer *feedTimer)
+            : fileName(fileName), feedTimer(feedTimer) {}
+
+    bool takeBatch(LoadBatch &batch) {
+        QMutexLocker locker(&mutex);
+        if (batches.isEmpty())
+            return false;
+        batch = batches.dequeue();
+        notFull.wakeOne();
+        return true;
+    }
+
+    bool isDone() {
+        QMutexLocker locker(&mutex);
+        return done && batches.isEmpty();
+    }
+
+    QString error() {
+        QMutexLocker locker(&mutex);
+        return errorString;
+    }
+
+    TextFileFormat format() {
+        QMutexLocker locker(&mutex);
+        return fileFormat;
+    }
+
+    void requestCancel() {
+        cancelled.storeRelease(1);
+        QMutexLocker locker(&mutex);
+        notFull.wakeAll();
+    }
+
+protected:
+    void run() override;
+
+private:
+    bool push(LoadBatch batch);
+    bool pushLines(QString &text, qint64 bytesEnd, bool flush);
+    void finish(const QString &error);
+
+    const QString fileName;
+    QTimer *const feedTimer;
+    QAtomicInt cancelled;
+
+    QMutex mutex;
+    QWaitCondition notFull;
+    QQueue<LoadBatch> batches;
+    bool done = false;
+    QString errorString;
+    TextFileFormat fileFormat;
+};
+
+void LoadWorker::run()
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        finish(file.errorString());
+        return;
+    }
+
+    // The mapping is backed by the page cache, so only the decoded chunk and the
+    // document itself live on the heap. Compressed files and devices that cannot be
+    // mapped are read ahead on a second thread. The first chunk decides between
+    // UTF-8 and Latin-1; a mapped file is then validated chunk by chunk as it is
+    // decoded, and read again as Latin-1 if a later chunk is not UTF-8 after all.
+    const Compression compression = compressionForFile(fileName);
+    const qint64 size = file.size();
+    uchar *mapped = compression == Compression::None && size > 0 ? file.map(0, size) : nullptr;
+    std::unique_ptr<ReadAheadWorker> readAhead;
+    if (!mapped) {
+        readAhead.reset(new ReadAheadWorker(&file, compression));
+        readAhead->start();
+    }
+
+    TextFileFormat format;
+    QByteArray chunk;
+    const char *data = nullptr;
+    qint64 length = 0;
+    qint64 offset = 0;
+    qint64 bytesEnd = 0;
+    // Bytes of the mapping known to be UTF-8, -1 when there is nothing to validate
+    qint64 validated = -1;
+    const char *const mappedData = reinterpret_cast<const char *>(mapped);
+    if (mapped) {
+        const qint64 head = size > firstChunkSize ? completeUtf8Sequences(mappedData, firstChunkSize) : size;
+        offset = detectEncoding(mappedData, head, &format);
+        if (format.encoding == TextFileFormat::Utf8 && !format.byteOrderMark)
+            validated = head;
+    } else if (readAhead->take(chunk, bytesEnd)) {
+        const int headLength = chunk.size() == firstChunkSize
+                ? int(completeUtf8Sequences(chunk.constData(), chunk.size())) : chunk.size();
+        const int bom = detectEncoding(chunk.constData(), headLength, &format);
+        data = chunk.constData() + bom;
+        length = chunk.size() - bom;
+    }
+    // The BOM is skipped here, a U+FEFF further on is text and must be kept
+    std::unique_ptr<QTextDecoder> decoder(format.codec()->makeDecoder(QTextCodec::IgnoreHeader));
+
+    LineEndingNormalizer lineEndings;
+    qint64 step = firstChunkSize;
+    QString pending;
+    // The size checked before the load is only an estimate for compressed files (gzip
+    // stores it modulo 4 GB), so the decoded text is measured as well
+    qint64 decodedLength = 0;
+    bool tooLarge = false;
+    while (!cancelled.loadAcquire()) {
+        if (mapped) {
+            if (offset >= size)
+                break;
+            data = mappedData + offset;
+            length = qMin(step, size - offset);
+            offset += length;
+            bytesEnd = offset;
+            step = chunkSize;
+            if (validated >= 0 && validated < offset) {
+                const qint64 end = offset == size ? size : completeUtf8Sequences(mappedData, offset);
+                if (!isValidUtf8(mappedData + validated, end - validated)) {
+                    format.encoding = TextFileFormat::Latin1;
+                    decoder.reset(format.codec()->makeDecoder(QTextCodec::IgnoreHeader));
+                    lineEndings = LineEndingNormalizer();
+                    pending.clear();
+                    decodedLength = 0;
+                    validated = -1;
+                    offset = 0;
+                    step = firstChunkSize;
+                    LoadBatch restart;
+                    restart.restart = true;
+                    if (!push(restart))
+                        break;
+                    continue;
+                }
+                validated = end;
+            }
+        } else if (!data) {
+            if (!readAhead->take(chunk, bytesEnd))
+                break;
+            data = chunk.constData();
+            length = chunk.size();
+        }
+
+        QString decoded = decoder->toUnicode(data, int(length));
+        data = nullptr;
+        decodedLength += decoded.size();
+        if (decodedLength > maxTextLength) {
+            tooLarge = true;
+            break;
+        }
+        lineEndings.normalize(decoded);
+        pending += decoded;
+        if (!pushLines(pending, bytesEnd, false))
+            break;
+    }
+    lineEndings.finish(pending);
+    if (!cancelled.loadAcquire() && !tooLarge)
+        pushLines(pending, bytesEnd, true);
+
+    QString error = tooLarge ? tooLargeError() : QString();
+    if (readAhead) {
+        readAhead->requestCancel();
+        readAhead->wait();
+        if (error.isEmpty())
+            error = readAhead->error();
+    }
+    if (mapped)
+        file.unmap(mapped);
+    if (error.isEmpty() && file.error() != QFile::NoError)
+        error = file.errorString();
+    if (lineEndings.hasLineEnding())
+        format.lineEnding = lineEndings.lineEnding();
+    {
+        QMutexLocker locker(&mutex);
+        fileFormat = format;
+    }
+    finish(error);
+}
+
+/* Hand over whole lines only, the partial last line waits for the next chunk
+   unless it is already a full batch on its own or the file is finished. */
+bool LoadWorker::pushLines(QString &text, qint64 bytesEnd, bool flush)
+{
+    int start = 0;
+    while (start < text.size()) {
+        const int remaining = text.size() - start;
+        int length = qMin(remaining, batchChars);
+        const int newline = text.lastIndexOf(QLatin1Char('\n'), start + length - 1);
+        if (newline >= start)
+            length = newline + 1 - start;
+        else if (remaining < batchChars && !flush)
+            break;
+
+        LoadBatch batch;
+        batch.text = text.mid(start, length);
+        batch.lines = batch.text.count(QLatin1Char('\n'));
+        start += length;
+        batch.bytesEnd = start == text.size() ? bytesEnd : -1;
+        if (!push(batch))
+            return false;
+    }
+    text.remove(0, start);
+    return true;
+}
+
+bool LoadWorker::push(LoadBatch batch)
+{
+    QMutexLocker locker(&mutex);
+    while (batches.size() >= maxQueuedBatches && !cancelled.loadAcquire())
+        notFull.wait(&mutex);
+    if (cancelled.loadAcquire())
+        return false;
+    batches.enqueue(batch);
+    // The feed timer stops whenever it drains the queue, wake it up again
+    if (batches.size() == 1)
+        QMetaObject::invokeMethod(feedTimer, "start", Qt::QueuedConnection);
+    return true;
+}
+
+void LoadWorker::finish(const QString &error)
+{
+    QMutexLocker locker(&mutex);
+    done = true;
+    errorString = error;
+    QMetaObject::invokeMethod(feedTimer, "start", Qt::QueuedConnection);
+}
+
+FileLoader::FileLoader(QObject *parent)
+        : QObject(parent), worker(nullptr), feedTimer(new QTimer(this)), collectText(false),
+          totalBytes(0), bytesLoaded(0), linesLoaded(0) {
+    feedTimer->setInterval(0);
+    connect(feedTimer, &QTimer::timeout, this, &FileLoader::feedDocument);
+}
+
+FileLoader::~FileLoader() {
+    if (worker) {
+        worker->requestCancel();
+        worker->wait();
+        delete worker;
+    }
+}
+
+bool FileLoader::open(const QString &fileName, qint64 *lengthBound) {
+    if (isLoading())
+        cancel();
+
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        lastError = file.errorString();
+        return false;
+    }
+    totalBytes = file.size();
+    // Refused up front rather than aborting on a failed allocation halfway through
+    QByteArray head;
+    {
+        DecompressingReader reader(&file, compressionForFile(fileName));
+        head = reader.read(4);
+    }
+    file.close();
+    const qint64 bound = decodedLengthBound(head, contentSize(fileName));
+    if (bound > maxTextLength) {
+        lastError = tooLargeError();
+        return false;
+    }
+    if (lengthBound)
+        *lengthBound = bound;
+
+    currentFile = fileName;
+    lastError.clear();
+    bytesLoaded = 0;
+    linesLoaded = 1;
+    text = QString();
+    fileFormat = TextFileFormat();
+    return true;
+}
+
+bool FileLoader::start(const QString &fileName, QTextDocument *document) {
+    if (!open(fileName))
+        return false;
+
+    // Views and counters are refreshed once at the end instead of after every batch
+    collectText = false;
+    this->document = document;
+    document->blockSignals(true);
+    document->setUndoRedoEnabled(false);
+    document->clear();
+    cursor = QTextCursor(document);
+
+    worker = new LoadWorker(fileName, feedTimer);
+    worker->start();
+    return true;
+}
+
+bool FileLoader::startText(const QString &fileName) {
+    qint64 lengthBound = 0;
+    if (!open(fileName, &lengthBound))
+        return false;
+
+    // Decoding never grows the text past the bound checked by open()
+    collectText = true;
+    document = nullptr;
+    text.reserve(int(lengthBound));
+
+    worker = new LoadWorker(fileName, feedTimer);
+    worker->start();
+    return true;
+}
+
+QString FileLoader::takeText() {
+    // Handed over without a copy, the piece table keeps this very buffer as its original
+    QString taken;
+    taken.swap(text);
+    return taken;
+}
+
+void FileLoader::feedDocument() {
+    if (!worker) {
+        feedTimer->stop();
+        return;
+    }
+    if (!collectText && !document) {
+        cancel();
+        return;
+    }
+
+    QElapsedTimer budget;
+    budget.start();
+    LoadBatch batch;
+    bool fed = false;
+    while (budget.elapsed() < feedBudgetMs && worker->takeBatch(batch)) {
+        if (batch.restart) {
+            if (collectText) {
+                text.truncate(0);
+            } else {
+                document->clear();
+                cursor = QTextCursor(document);
+            }
+            bytesLoaded = 0;
+            linesLoaded = 1;
+            fed = true;
+            continue;
+        }
+        if (collectText)
+            text += batch.text;
+        else
+            cursor.insertText(batch.text);
+        linesLoaded += batch.lines;
+        if (batch.bytesEnd >= 0)
+            bytesLoaded = batch.bytesEnd;
+        fed = true;
+    }
+    if (fed)
+        emit progress(bytesLoaded, qMax(totalBytes, bytesLoaded), linesLoaded);
+
+    if (worker->isDone()) {
+        lastError = worker->error();
+        fileFormat = worker->format();
+        finish(lastError.isEmpty());
+    } else if (!fed) {
+        feedTimer->stop();
+    }
+}
+
+void FileLoader::cancel() {
+    if (!worker)
+        return;
+    worker->requestCancel();
+    finish(false);
+}
+
+void FileLoader::finish(bool completed) {
+    feedTimer->stop();
+    worker->wait();
+    delete worker;
+    worker = nullptr;
+    cursor = QTextCursor();
+    if (!completed)
+        text = QString();
+
+    if (document) {
+        document->setUndoRedoEnabled(true);
+        document->blockSignals(false);
+    }
+    emit finished(completed);
+}
+
+bool FileLoader::readAll(const QString &fileName, QString *text, QString *errorString, TextFileFormat *format) {
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        *errorString = file.errorString();
+        return false;
+    }
+
+    const Compression compression = compressionForFile(fileName);
+    const qint64 size = file.size();
+    uchar *mapped = compression == Compression::None && size > 0 ? file.map(0, size) : nullptr;
+    // Content past this many bytes decodes past maxTextLength whatever the encoding
+    const qint64 maxBytes = 2 * maxTextLength;
+    QByteArray data;
+    if (mapped) {
+        if (size > maxBytes) {
+            file.unmap(mapped);
+            *errorString = tooLargeError();
+            return false;
+        }
+        data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), int(size));
+    } else {
+        DecompressingReader reader(&file, compression);
+        for (QByteArray chunk = reader.read(chunkSize); !chunk.isEmpty(); chunk = reader.read(chunkSize)) {
+            if (data.size() + qint64(chunk.size()) > maxBytes) {
+                *errorString = tooLargeError();
+                return false;
+            }
+            data += chunk;
+        }
+        if (reader.hasError()) {
+            *errorString = reader.errorString();
+            return false;
+        }
+    }
+    if (decodedLengthBound(data.left(4), data.size()) > maxTextLength) {
+        if (mapped)
+            file.unmap(mapped);
+        *errorString = tooLargeError();
+        return false;
+    }
+
+    TextFileFormat detected;
+    const int bom = detectEncoding(data.constData(), data.size(), &detected);
+    std::unique_ptr<QTextDecoder> decoder(detected.codec()->makeDecoder(QTextCodec::IgnoreHeader));
+    *text = decoder->toUnicode(data.constData() + bom, data.size() - bom);
+    LineEndingNormalizer lineEndings;
+    lineEndings.normalize(*text);
+    lineEndings.finish(*text);
+    if (lineEndings.hasLineEnding())
+        detected.lineEnding = lineEndings.lineEnding();
+    if (format)
+        *format = detected;
+
+    if (mapped)
+        file.unmap(mapped);
+    return true;
+}
+
+bool FileLoader::isLoading() const {
+    return worker != nullptr;
+}
+
+QString FileLoader::fileName() const {
+    return currentFile;
+}
+
+TextFileFormat FileLoader::format() const {
+    return fileFormat;
+}
+
+QString FileLoader::errorString() const {
+    return lastError;
+}
@@ -0,0 +1,68 @@
+#ifndef FILELOADER_HPP
+#define FILELOADER_HPP
+
+#include <QObject>
+#include <QString>
+#include <QPointer>
+#include <QTextCursor>
+#include "textencoding.hpp"
+
+class QTextDocument;
+class QTimer;
+class LoadWorker;
+
+class FileLoader : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit FileLoader(QObject *parent = nullptr);
+    ~FileLoader() override;
+
+    /* Démarrer le chargement en arrière-plan ; le document est rempli par lots */
+    bool start(const QString &fileName, QTextDocument *document);
+    /* Même chargement, mais le texte est seulement accumulé (mode grand fichier), voir takeText() */
+    bool startText(const QString &fileName);
+    /* Le texte accumulé, cédé sans copie */
+    QString takeText();
+    void cancel();
+    bool isLoading() const;
+    QString fileName() const;
+    QString errorString() const;
+    /* Encodage et fin de ligne détectés par le dernier chargement terminé */
+    TextFileFormat format() const;
+
+    /* Lecture synchrone avec le même décodage, pour rejouer un journal sur son fichier.
+       Comme start(), refuse un fichier de plus d'environ 2^30 caractères */
+    static bool readAll(const QString &fileName, QString *text, QString *errorString,
+                        TextFileFormat *format = nullptr);
+
+signals:
+    void progress(qint64 bytesLoaded, qint64 totalBytes, qint64 linesLoaded);
+    /* completed est faux en cas d'annulation ou d'erreur (voir errorString) */
+    void finished(bool completed);
+
+private slots:
+    void feedDocument();
+
+private:
+    /* Refuse un texte qui ne tiendrait pas dans une QString ; lengthBound reçoit le
+       nombre de caractères au plus que donnera le décodage */
+    bool open(const QString &fileName, qint64 *lengthBound = nullptr);
+    void finish(bool completed);
+
+    LoadWorker *worker;
+    QTimer *feedTimer;
+    QPointer<QTextDocument> document;
+    QTextCursor cursor;
+    bool collectText;
+    QString text;
+    QString currentFile;
+    QString lastError;
+    TextFileFormat fileFormat;
+    qint64 totalBytes;
+    qint64 bytesLoaded;
+    qint64 linesLoaded;
+};
+
+#endif
@@ -0,0 +1,222 @@
+#include "filesaver.hpp"
+#include "nativeformat.hpp"
+#include "compression.hpp"
+#include <QSaveFile>
+#include <QTextDocument>
+#include <QTextCodec>
+#include <QThread>
+#include <memory>
+#include <algorithm>
+
+// Characters encoded and written per step
+static const int encodeChars = 1024 * 1024;
+
+/* Encodes the snapshot with the encoding and line endings the file was read with,
+   compresses it step by step when the name asks for it (.gz, .zst),
+   and writes it through QSaveFile, which only replaces the
+   target by an atomic rename once everything has reached the disk. A document
+   snapshot is written in the native format instead, and deleted afterwards; a text
+   snapshot to save natively is made into a document here, off the GUI thread. */
+class SaveWorker : public QThread
+{
+public:
+    SaveWorker(const QString &fileName, const PieceTable::Snapshot &snapshot, const TextFileFormat &format,
+               QTextDocument *document, bool native, const QMap<int, QString> &comments)
+            : fileName(fileName), snapshot(snapshot), format(format), document(document), native(native),
+              comments(comments) {
+        if (document)
+            document->moveToThread(this);
+    }
+
+    const QString fileName;
+    bool ok = false;
+    QString errorString;
+
+protected:
+    void run() override {
+        if (native && !document) {
+            document = new QTextDocument;
+            document->setPlainText(snapshot.text(0, snapshot.length()));
+            snapshot = PieceTable::Snapshot();
+        }
+        if (document) {
+            writeDocument();
+            return;
+        }
+
+        // Line endings are written explicitly, the device must not translate them
+        QSaveFile file(fileName);
+        if (!file.open(QFile::WriteOnly)) {
+            errorString = file.errorString();
+            return;
+        }
+
+        // Latin-1 cannot hold what may have been typed since, such files become UTF-8
+        if (format.encoding == TextFileFormat::Latin1 && !fitsLatin1()) {
+            format.encoding = TextFileFormat::Utf8;
+            format.byteOrderMark = false;
+        }
+
+        CompressingWriter out(&file, compressionForFile(fileName));
+        if (!out.write(format.byteOrderMarkBytes())) {
+            errorString = out.errorString();
+            file.cancelWriting();
+            return;
+        }
+
+        const QString lineEnd = format.lineEnding == TextFileFormat::CRLF ? QStringLiteral("\r\n")
+                                                                          : QStringLiteral("\r");
+        std::unique_ptr<QTextEncoder> encoder(format.codec()->makeEncoder(QTextCodec::IgnoreHeader));
+        for (int pos = 0; pos < snapshot.length(); ) {
+            const QChar *data;
+            const int length = qMin(encodeChars, snapshot.chunkAt(pos, &data));
+            pos += length;
+            QByteArray bytes;
+            if (format.lineEnding == TextFileFormat::LF) {
+                bytes = encoder->fromUnicode(data, length);
+            } else {
+                QString step(data, length);
+                step.replace(QLatin1Char('\n'), lineEnd);
+                bytes = encoder->fromUnicode(step);
+            }
+            if (!out.write(bytes)) {
+                errorString = out.errorString();
+                file.cancelWriting();
+                return;
+            }
+        }
+        snapshot = PieceTable::Snapshot();
+        if (!out.finish()) {
+            errorString = out.errorString();
+            file.cancelWriting();
+            return;
+        }
+
+        if (!file.commit()) {
+            errorString = file.errorString();
+            return;
+        }
+        ok = true;
+    }
+
+private:
+    bool fitsLatin1() const {
+        for (int pos = 0; pos < snapshot.length(); ) {
+            const QChar *data;
+            const int length = snapshot.chunkAt(pos, &data);
+            if (std::any_of(data, data + length, [](QChar c) { return c.unicode() > 0xff; }))
+                return false;
+            pos += length;
+        }
+        return true;
+    }
+
+    void writeDocument() {
+        QSaveFile file(fileName);
+        if (!file.open(QFile::WriteOnly)) {
+            errorString = file.errorString();
+        } else if (!NativeFormat::write(&file, document, comments, &errorString)) {
+            file.cancelWriting();
+        } else if (!file.commit()) {
+            errorString = file.errorString();
+        } else {
+            ok = true;
+        }
+        delete document;
+        document = nullptr;
+    }
+
+    PieceTable::Snapshot snapshot;
+    TextFileFormat format;
+    QTextDocument *document;
+    const bool native;
+    const QMap<int, QString> comments;
+};
+
+FileSaver::FileSaver(QObject *parent)
+        : QObject(parent), worker(nullptr), lastSaveOk(true) {}
+
+FileSaver::~FileSaver() {
+    waitForFinished();
+}
+
+void FileSaver::save(const QString &fileName, const PieceTable::Snapshot &snapshot, const TextFileFormat &format) {
+    Request request;
+    request.fileName = fileName;
+    request.snapshot = snapshot;
+    request.format = format;
+    enqueue(request);
+}
+
+void FileSaver::saveDocument(const QString &fileName, QTextDocument *snapshot, const QMap<int, QString> &comments) {
+    Request request;
+    request.fileName = fileName;
+    request.document = snapshot;
+    request.comments = comments;
+    enqueue(request);
+}
+
+void FileSaver::saveDocument(const QString &fileName, const PieceTable::Snapshot &snapshot,
+                             const QMap<int, QString> &comments) {
+    Request request;
+    request.fileName = fileName;
+    request.snapshot = snapshot;
+    request.native = true;
+    request.comments = comments;
+    enqueue(request);
+}
+
+void FileSaver::enqueue(const Request &request) {
+    // A newer snapshot of the same file supersedes one that has not started yet. Saves to
+    // other files, a Save As while the previous save waits, are all written in turn
+    for (int i = 0; i < pending.size(); ++i) {
+        if (pending.at(i).fileName == request.fileName) {
+            delete pending.at(i).document;
+            pending.removeAt(i);
+            break;
+        }
+    }
+    pending.append(request);
+    if (!worker)
+        startNext();
+}
+
+void FileSaver::startNext() {
+    if (pending.isEmpty())
+        return;
+    const Request next = pending.takeFirst();
+    worker = new SaveWorker(next.fileName, next.snapshot, next.format, next.document, next.native, next.comments);
+    connect(worker, &QThread::finished, this, &FileSaver::workerFinished);
+    worker->start();
+}
+
+void FileSaver::workerFinished() {
+    // Results already collected by waitForFinished leave a stale queued call behind
+    if (!worker || !worker->isFinished())
+        return;
+
+    SaveWorker *done = worker;
+    worker = nullptr;
+    lastSaveOk = done->ok;
+    const QString fileName = done->fileName;
+    const QString errorString = done->errorString;
+    done->wait();
+    delete done;
+
+    startNext();
+    emit finished(fileName, lastSaveOk, errorString);
+}
+
+bool FileSaver::isSaving() const {
+    return worker != nullptr;
+}
+
+bool FileSaver::waitForFinished() {
+    bool ok = true;
+    while (worker) {
+        worker->wait();
+        workerFinished();
+        ok = ok && lastSaveOk;
+    }
+    return ok;
+}
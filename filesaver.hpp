@@ -0,0 +1,63 @@
+#ifndef FILESAVER_HPP
+#define FILESAVER_HPP
+
+#include <QObject>
+#include <QString>
+#include <QMap>
+#include <QList>
+#include "textencoding.hpp"
+#include "piecetable.hpp"
+
+class QTextDocument;
+class SaveWorker;
+
+class FileSaver : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit FileSaver(QObject *parent = nullptr);
+    ~FileSaver() override;
+
+    /* Écrire l'instantané en arrière-plan. Un enregistrement en attente vers le même fichier
+       est remplacé ; ceux vers d'autres fichiers attendent leur tour et émettent chacun
+       finished(). Le texte n'est mis bout à bout que morceau par morceau, sur le thread d'écriture */
+    void save(const QString &fileName, const PieceTable::Snapshot &snapshot, const TextFileFormat &format);
+    /* Enregistrer au format natif une copie du document (clone()), le saver en devient propriétaire */
+    void saveDocument(const QString &fileName, QTextDocument *snapshot, const QMap<int, QString> &comments);
+    /* Format natif à partir du texte brut (mode grand fichier) : le document est construit
+       sur le thread d'écriture */
+    void saveDocument(const QString &fileName, const PieceTable::Snapshot &snapshot,
+                      const QMap<int, QString> &comments);
+    bool isSaving() const;
+    /* Bloquer jusqu'à la fin des écritures, faux si l'une d'elles a échoué */
+    bool waitForFinished();
+
+signals:
+    void finished(const QString &fileName, bool ok, const QString &errorString);
+
+private slots:
+    void workerFinished();
+
+private:
+    struct Request
+    {
+        QString fileName;
+        PieceTable::Snapshot snapshot;
+        TextFileFormat format;
+        /* Copie du document à écrire au format natif, ou nul */
+        QTextDocument *document = nullptr;
+        /* Format natif construit depuis le texte brut de snapshot */
+        bool native = false;
+        QMap<int, QString> comments;
+    };
+
+    void enqueue(const Request &request);
+    void startNext();
+
+    SaveWorker *worker;
+    QList<Request> pending;
+    bool lastSaveOk;
+};
+
+#endif
@@ -0,0 +1,283 @@
+#include "filesearch.hpp"
+#include "textencoding.hpp"
+#include "compression.hpp"
+#include "literalsearch.hpp"
+#include <QFile>
+#include <QDirIterator>
+#include <QTextCodec>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QTimer>
+#include <QAtomicInt>
+#include <cstring>
+#include <memory>
+
+// Bytes decoded at once, and bytes looked at to tell text from binary files
+static const qint64 chunkSize = 4 * 1024 * 1024;
+static const int binaryProbe = 8 * 1024;
+// Characters of the line kept before and after a match for its preview
+static const int previewBefore = 40;
+static const int previewAfter = 80;
+// Interval at which results found by the pool are handed to the GUI thread
+static const int deliverIntervalMs = 100;
+
+struct FileSearch::Shared
+{
+    SearchQuery query;
+    QAtomicInt cancelled;
+    /* Files queued or being scanned, plus one while the directory is still walked */
+    QAtomicInt outstanding;
+    QAtomicInt filesScanned;
+
+    QMutex mutex;
+    QVector<FileMatch> pending;
+};
+
+static QString previewOf(const QString &text, int lineStart, int start, int length)
+{
+    const int from = qMax(lineStart, start - previewBefore);
+    int to = qMin(text.size(), start + length + previewAfter);
+    const int lineEnd = text.indexOf(QLatin1Char('\n'), start + length);
+    if (lineEnd >= 0 && lineEnd < to)
+        to = lineEnd;
+    QString preview = text.mid(from, to - from).trimmed();
+    preview.replace(QLatin1Char('\t'), QLatin1Char(' '));
+    return preview;
+}
+
+/* Decodes one file chunk by chunk and collects its matches. Only the undecided tail
+   of each chunk, and the start of the current line for previews, are carried over */
+static void scanFile(const QString &fileName, FileSearch::Shared *shared)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+        return;
+
+    // Same reading as the loader: mapped when possible, otherwise inflated as a stream
+    const Compression compression = compressionForFile(fileName);
+    const qint64 size = file.size();
+    uchar *mapped = compression == Compression::None && size > 0 ? file.map(0, size) : nullptr;
+    std::unique_ptr<DecompressingReader> reader;
+    if (!mapped)
+        reader.reset(new DecompressingReader(&file, compression));
+
+    TextFileFormat format;
+    QByteArray chunk;
+    const char *data = nullptr;
+    qint64 length = 0;
+    qint64 position = 0;
+    // As for compressed files, the first chunk alone decides between UTF-8 and Latin-1
+    if (mapped) {
+        const char *const head = reinterpret_cast<const char *>(mapped);
+        position = detectEncoding(head, size > chunkSize ? completeUtf8Sequences(head, chunkSize) : size, &format);
+        data = head + position;
+        length = qMin(size - position, qint64(binaryProbe));
+    } else {
+        chunk = reader->read(chunkSize);
+        const int headLength = chunk.size() == chunkSize
+                ? int(completeUtf8Sequences(chunk.constData(), chunk.size())) : chunk.size();
+        const int bom = detectEncoding(chunk.constData(), headLength, &format);
+        data = chunk.constData() + bom;
+        length = chunk.size() - bom;
+    }
+    // NUL bytes mark binary files, except in UTF-16 where every ASCII character has one
+    const bool utf16 = format.encoding == TextFileFormat::Utf16LE || format.encoding == TextFileFormat::Utf16BE;
+    if (!utf16 && std::memchr(data, 0, size_t(qMin<qint64>(length, binaryProbe)))) {
+        if (mapped)
+            file.unmap(mapped);
+        return;
+    }
+    if (mapped)
+        data = nullptr;
+    std::unique_ptr<QTextDecoder> decoder(format.codec()->makeDecoder(QTextCodec::IgnoreHeader));
+
+    const SearchQuery &query = shared->query;
+    const LiteralMatcher matcher(query.pattern, query.caseSensitivity);
+    const int patternLength = matcher.size();
+    LineEndingNormalizer lineEndings;
+    QVector<FileMatch> matches;
+    QString text;
+    // Positions in text: where matches may still start, up to where lines were counted,
+    // and the start of the current line (negative once it was dropped)
+    int scanned = 0;
+    int counted = 0;
+    int lineStart = 0;
+    int line = 0;
+    bool last = false;
+    while (!last && !shared->cancelled.loadAcquire()) {
+        if (mapped) {
+            last = position >= size;
+            data = reinterpret_cast<const char *>(mapped) + position;
+            length = qMin(chunkSize, size - position);
+            position += length;
+        } else if (!data) {
+            chunk = reader->read(chunkSize);
+            data = chunk.constData();
+            length = chunk.size();
+            last = chunk.isEmpty();
+        }
+        QString decoded = decoder->toUnicode(data, int(length));
+        data = nullptr;
+        lineEndings.normalize(decoded);
+        if (last)
+            lineEndings.finish(decoded);
+        text += decoded;
+
+        // A match starting before limit has its characters and the one after it decoded
+        const int limit = last ? text.size() : qMax(scanned, text.size() - patternLength);
+        int i = matcher.indexIn(text, scanned);
+        while (i >= 0 && i < limit) {
+            if (query.wholeWords) {
+                const bool before = i > 0 && isWordCharacter(text.at(i - 1));
+                const bool after = i + patternLength < text.size() && isWordCharacter(text.at(i + patternLength));
+                if (before || after) {
+                    i = matcher.indexIn(text, i + 1);
+                    continue;
+                }
+            }
+            for (; counted < i; ++counted) {
+                if (text.at(counted) == QLatin1Char('\n')) {
+                    ++line;
+                    lineStart = counted + 1;
+                }
+            }
+            matches.append({fileName, line + 1, previewOf(text, qMax(0, lineStart), i, patternLength)});
+            scanned = i + patternLength;
+            i = matcher.indexIn(text, scanned);
+        }
+        scanned = qMax(scanned, limit);
+        for (; counted < scanned; ++counted) {
+            if (text.at(counted) == QLatin1Char('\n')) {
+                ++line;
+                lineStart = counted + 1;
+            }
+        }
+
+        // Keep one character before the next possible match for the whole word test
+        const int keep = qMin(qMax(lineStart, scanned - previewBefore), qMax(0, scanned - 1));
+        if (keep > 0) {
+            text.remove(0, keep);
+            scanned -= keep;
+            counted -= keep;
+            lineStart -= keep;
+        }
+    }
+
+    if (mapped)
+        file.unmap(mapped);
+    if (!matches.isEmpty()) {
+        QMutexLocker locker(&shared->mutex);
+        shared->pending += matches;
+    }
+}
+
+class ScanTask : public QRunnable
+{
+public:
+    ScanTask(const QString &fileName, const std::shared_ptr<FileSearch::Shared> &shared)
+            : fileName(fileName), shared(shared) {}
+
+    void run() override {
+        if (!shared->cancelled.loadAcquire()) {
+            scanFile(fileName, shared.get());
+            shared->filesScanned.fetchAndAddRelaxed(1);
+        }
+        shared->outstanding.fetchAndAddRelease(-1);
+    }
+
+private:
+    const QString fileName;
+    const std::shared_ptr<FileSearch::Shared> shared;
+};
+
+/* Walks the directory on the pool and queues one scan per file as it goes,
+   so results show up before the walk is over */
+class WalkTask : public QRunnable
+{
+public:
+    WalkTask(const QString &directory, const QStringList &nameFilters, QThreadPool *pool,
+             const std::shared_ptr<FileSearch::Shared> &shared)
+            : directory(directory), nameFilters(nameFilters), pool(pool), shared(shared) {}
+
+    void run() override {
+        QDirIterator it(directory, nameFilters, QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+        while (it.hasNext() && !shared->cancelled.loadAcquire()) {
+            shared->outstanding.fetchAndAddRelaxed(1);
+            pool->start(new ScanTask(it.next(), shared));
+        }
+        shared->outstanding.fetchAndAddRelease(-1);
+    }
+
+private:
+    const QString directory;
+    const QStringList nameFilters;
+    QThreadPool *const pool;
+    const std::shared_ptr<FileSearch::Shared> shared;
+};
+
+FileSearch::FileSearch(QObject *parent)
+        : QObject(parent), pool(new QThreadPool(this)), deliverTimer(new QTimer(this)) {
+    // The walk takes one thread, scans may be waiting on the disk: one extra thread keeps the cores busy
+    pool->setMaxThreadCount(QThread::idealThreadCount() + 1);
+    deliverTimer->setInterval(deliverIntervalMs);
+    connect(deliverTimer, &QTimer::timeout, this, &FileSearch::deliver);
+}
+
+FileSearch::~FileSearch() {
+    // No finished() from here, the receiver may already be half destroyed
+    if (shared)
+        shared->cancelled.storeRelease(1);
+    pool->waitForDone();
+}
+
+void FileSearch::start(const QString &directory, const QStringList &nameFilters, const SearchQuery &query) {
+    cancel();
+    if (query.pattern.isEmpty())
+        return;
+
+    // Tasks of the previous search keep their own state and finish unobserved
+    shared = std::make_shared<Shared>();
+    shared->query = query;
+    shared->outstanding.storeRelease(1);
+    pool->start(new WalkTask(directory, nameFilters, pool, shared));
+    deliverTimer->start();
+}
+
+void FileSearch::cancel() {
+    if (!shared)
+        return;
+    shared->cancelled.storeRelease(1);
+    deliverTimer->stop();
+    const int scanned = shared->filesScanned.loadAcquire();
+    shared.reset();
+    emit finished(scanned, true);
+}
+
+bool FileSearch::isRunning() const {
+    return bool(shared);
+}
+
+void FileSearch::deliver() {
+    // A slot of found() may cancel the search, which drops this->shared
+    const std::shared_ptr<Shared> shared = this->shared;
+    // Read before taking the results, so that the last batch is not left behind
+    const bool done = shared->outstanding.loadAcquire() == 0;
+    QVector<FileMatch> matches;
+    {
+        QMutexLocker locker(&shared->mutex);
+        matches.swap(shared->pending);
+    }
+    if (!matches.isEmpty()) {
+        emit found(matches);
+        if (this->shared != shared)
+            return;
+    }
+    if (done) {
+        deliverTimer->stop();
+        const int scanned = shared->filesScanned.loadAcquire();
+        this->shared.reset();
+        emit finished(scanned, false);
+    }
+}
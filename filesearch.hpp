@@ -0,0 +1,55 @@
+#ifndef FILESEARCH_HPP
+#define FILESEARCH_HPP
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+#include "textsearch.hpp"
+
+class QThreadPool;
+class QTimer;
+
+/* Occurrence trouvée dans un fichier, ligne à partir de 1 */
+struct FileMatch
+{
+    QString fileName;
+    int line;
+    /* Extrait de la ligne autour de l'occurrence */
+    QString preview;
+};
+
+/* Recherche dans tous les fichiers d'un dossier : chaque fichier est projeté en mémoire
+   (ou décompressé en flux) et parcouru sur un pool de threads, avec la même requête
+   que la barre de recherche. Les résultats arrivent par lots pendant la recherche */
+class FileSearch : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit FileSearch(QObject *parent = nullptr);
+    ~FileSearch() override;
+
+    /* nameFilters vide : tous les fichiers ; une recherche en cours est abandonnée */
+    void start(const QString &directory, const QStringList &nameFilters, const SearchQuery &query);
+    void cancel();
+    bool isRunning() const;
+
+    /* Partagé avec les tâches du pool, qui peuvent survivre à une recherche annulée */
+    struct Shared;
+
+signals:
+    void found(const QVector<FileMatch> &matches);
+    void finished(int filesScanned, bool cancelled);
+
+private slots:
+    void deliver();
+
+private:
+    QThreadPool *pool;
+    QTimer *deliverTimer;
+    std::shared_ptr<Shared> shared;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "findbar.hpp"
+#include <QLineEdit>
+#include <QLabel>
+#include <QCheckBox>
+#include <QKeyEvent>
+#include <QGuiApplication>
+
+FindBar::FindBar(QWidget *parent)
+        : QToolBar(tr("Find"), parent) {
+    setObjectName("findBar");
+    setMovable(false);
+
+    patternEdit = new QLineEdit(this);
+    patternEdit->setPlaceholderText(tr("Find"));
+    patternEdit->setClearButtonEnabled(true);
+    patternEdit->setMaximumWidth(300);
+    addWidget(patternEdit);
+
+    addAction(tr("Previous"), this, &FindBar::findPrevious);
+    addAction(tr("Next"), this, &FindBar::findNext);
+
+    caseCheck = new QCheckBox(tr("Match case"), this);
+    addWidget(caseCheck);
+    wordsCheck = new QCheckBox(tr("Whole words"), this);
+    addWidget(wordsCheck);
+
+    statusLabel = new QLabel(this);
+    statusLabel->setMinimumWidth(120);
+    statusLabel->setContentsMargins(8, 0, 8, 0);
+    addWidget(statusLabel);
+
+    addAction(tr("Close"), this, &QWidget::hide);
+
+    connect(patternEdit, &QLineEdit::textChanged, this, &FindBar::queryChanged);
+    connect(caseCheck, &QCheckBox::toggled, this, &FindBar::queryChanged);
+    connect(wordsCheck, &QCheckBox::toggled, this, &FindBar::queryChanged);
+    // Return finds the next match, Shift+Return the previous one
+    connect(patternEdit, &QLineEdit::returnPressed, this, [this]() {
+        if (QGuiApplication::keyboardModifiers() & Qt::ShiftModifier)
+            emit findPrevious();
+        else
+            emit findNext();
+    });
+}
+
+SearchQuery FindBar::query() const {
+    SearchQuery query;
+    query.pattern = patternEdit->text();
+    query.caseSensitivity = caseCheck->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    query.wholeWords = wordsCheck->isChecked();
+    return query;
+}
+
+void FindBar::setStatus(const QString &status) {
+    statusLabel->setText(status);
+}
+
+void FindBar::activate() {
+    show();
+    patternEdit->setFocus();
+    patternEdit->selectAll();
+}
+
+void FindBar::keyPressEvent(QKeyEvent *event) {
+    if (event->key() == Qt::Key_Escape) {
+        hide();
+        return;
+    }
+    QToolBar::keyPressEvent(event);
+}
+
+void FindBar::hideEvent(QHideEvent *event) {
+    QToolBar::hideEvent(event);
+    emit closed();
+}
@@ -0,0 +1,42 @@
+#ifndef FINDBAR_HPP
+#define FINDBAR_HPP
+
+#include <QToolBar>
+#include "textsearch.hpp"
+
+class QLineEdit;
+class QLabel;
+class QCheckBox;
+
+/* Barre de recherche non modale : la recherche suit la frappe, le résultat
+   (nombre d'occurrences, navigation) est géré par la fenêtre principale */
+class FindBar : public QToolBar
+{
+Q_OBJECT
+
+public:
+    explicit FindBar(QWidget *parent = nullptr);
+
+    SearchQuery query() const;
+    void setStatus(const QString &status);
+    /* Afficher la barre et placer le curseur dans le champ, son texte sélectionné */
+    void activate();
+
+signals:
+    void queryChanged();
+    void findNext();
+    void findPrevious();
+    void closed();
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
+
+private:
+    QLineEdit *patternEdit;
+    QCheckBox *caseCheck;
+    QCheckBox *wordsCheck;
+    QLabel *statusLabel;
+};
+
+#endif
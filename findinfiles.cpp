@@ -0,0 +1,139 @@
+#include "findinfiles.hpp"
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QPushButton>
+#include <QLabel>
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QFileDialog>
+#include <QDir>
+
+// Matches listed at most; the search stops there, the list would be of no use beyond
+static const int maxListedMatches = 10000;
+
+FindInFilesPanel::FindInFilesPanel(QWidget *parent)
+        : QWidget(parent), search(new FileSearch(this)), matchCount(0) {
+    patternEdit = new QLineEdit(this);
+    patternEdit->setPlaceholderText(tr("Find"));
+    patternEdit->setClearButtonEnabled(true);
+    directoryEdit = new QLineEdit(QDir::homePath(), this);
+    QPushButton *browseButton = new QPushButton(tr("Browse..."), this);
+    filterEdit = new QLineEdit(this);
+    filterEdit->setPlaceholderText(tr("All files, or e.g. *.txt *.md"));
+    caseCheck = new QCheckBox(tr("Match case"), this);
+    wordsCheck = new QCheckBox(tr("Whole words"), this);
+    searchButton = new QPushButton(tr("Search"), this);
+
+    results = new QTreeWidget(this);
+    results->setColumnCount(3);
+    results->setHeaderLabels({tr("File"), tr("Line"), tr("Text")});
+    results->setRootIsDecorated(false);
+    results->setUniformRowHeights(true);
+    results->header()->setStretchLastSection(true);
+    statusLabel = new QLabel(this);
+
+    QGridLayout *form = new QGridLayout;
+    form->addWidget(new QLabel(tr("Find:"), this), 0, 0);
+    form->addWidget(patternEdit, 0, 1, 1, 2);
+    form->addWidget(new QLabel(tr("In:"), this), 1, 0);
+    form->addWidget(directoryEdit, 1, 1);
+    form->addWidget(browseButton, 1, 2);
+    form->addWidget(new QLabel(tr("Files:"), this), 2, 0);
+    form->addWidget(filterEdit, 2, 1, 1, 2);
+    QHBoxLayout *options = new QHBoxLayout;
+    options->addWidget(caseCheck);
+    options->addWidget(wordsCheck);
+    options->addStretch();
+    options->addWidget(searchButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(form);
+    layout->addLayout(options);
+    layout->addWidget(results);
+    layout->addWidget(statusLabel);
+
+    connect(browseButton, &QPushButton::clicked, this, &FindInFilesPanel::browse);
+    connect(searchButton, &QPushButton::clicked, this, &FindInFilesPanel::startOrStop);
+    connect(patternEdit, &QLineEdit::returnPressed, this, &FindInFilesPanel::startOrStop);
+    connect(search, &FileSearch::found, this, &FindInFilesPanel::addMatches);
+    connect(search, &FileSearch::finished, this, &FindInFilesPanel::searchFinished);
+    connect(results, &QTreeWidget::itemClicked, this, &FindInFilesPanel::openItem);
+}
+
+void FindInFilesPanel::setDirectory(const QString &directory) {
+    if (!search->isRunning() && !directory.isEmpty())
+        directoryEdit->setText(QDir::toNativeSeparators(directory));
+}
+
+void FindInFilesPanel::activate() {
+    patternEdit->setFocus();
+    patternEdit->selectAll();
+}
+
+void FindInFilesPanel::browse() {
+    const QString directory = QFileDialog::getExistingDirectory(this, tr("Find in Files"), directoryEdit->text());
+    if (!directory.isEmpty())
+        directoryEdit->setText(QDir::toNativeSeparators(directory));
+}
+
+void FindInFilesPanel::startOrStop() {
+    if (search->isRunning()) {
+        search->cancel();
+        return;
+    }
+
+    SearchQuery query;
+    query.pattern = patternEdit->text();
+    query.caseSensitivity = caseCheck->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    query.wholeWords = wordsCheck->isChecked();
+    searchedDirectory = QDir::fromNativeSeparators(directoryEdit->text());
+    if (query.pattern.isEmpty() || !QDir(searchedDirectory).exists()) {
+        statusLabel->setText(query.pattern.isEmpty() ? QString() : tr("No such folder"));
+        return;
+    }
+
+    results->clear();
+    matchCount = 0;
+    statusLabel->setText(tr("Searching..."));
+    searchButton->setText(tr("Stop"));
+    search->start(searchedDirectory, filterEdit->text().split(QLatin1Char(' '), QString::SkipEmptyParts), query);
+}
+
+void FindInFilesPanel::addMatches(const QVector<FileMatch> &matches) {
+    const QDir directory(searchedDirectory);
+    QList<QTreeWidgetItem *> items;
+    for (const FileMatch &match : matches) {
+        if (matchCount + items.size() >= maxListedMatches)
+            break;
+        QTreeWidgetItem *item = new QTreeWidgetItem({QDir::toNativeSeparators(directory.relativeFilePath(match.fileName)),
+                                                     QString::number(match.line), match.preview});
+        item->setData(0, Qt::UserRole, match.fileName);
+        item->setData(1, Qt::UserRole, match.line);
+        item->setTextAlignment(1, Qt::AlignRight);
+        items.append(item);
+    }
+    // One insertion per batch keeps the view responsive however fast the files come in
+    results->addTopLevelItems(items);
+    matchCount += items.size();
+    statusLabel->setText(tr("Searching... %n match(es)", nullptr, matchCount));
+    if (matchCount >= maxListedMatches)
+        search->cancel();
+}
+
+void FindInFilesPanel::searchFinished(int filesScanned, bool cancelled) {
+    searchButton->setText(tr("Search"));
+    QString status = tr("%n match(es)", nullptr, matchCount) + QLatin1String(", ")
+                     + tr("%n file(s) searched", nullptr, filesScanned);
+    if (matchCount >= maxListedMatches)
+        status += tr(", stopped at the first %1").arg(maxListedMatches);
+    else if (cancelled)
+        status += tr(", stopped");
+    statusLabel->setText(status);
+}
+
+void FindInFilesPanel::openItem(QTreeWidgetItem *item) {
+    emit openRequested(item->data(0, Qt::UserRole).toString(), item->data(1, Qt::UserRole).toInt());
+}
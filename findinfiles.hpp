@@ -0,0 +1,51 @@
+#ifndef FINDINFILES_HPP
+#define FINDINFILES_HPP
+
+#include <QWidget>
+#include "filesearch.hpp"
+
+class QLineEdit;
+class QCheckBox;
+class QPushButton;
+class QLabel;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+/* Panneau « Rechercher dans les fichiers » : dossier, filtres et requête, puis la liste
+   des occurrences remplie au fil de la recherche ; un clic ouvre le fichier à la ligne */
+class FindInFilesPanel : public QWidget
+{
+Q_OBJECT
+
+public:
+    explicit FindInFilesPanel(QWidget *parent = nullptr);
+
+    void setDirectory(const QString &directory);
+    /* Placer le curseur dans le champ de recherche */
+    void activate();
+
+signals:
+    void openRequested(const QString &fileName, int line);
+
+private slots:
+    void browse();
+    void startOrStop();
+    void addMatches(const QVector<FileMatch> &matches);
+    void searchFinished(int filesScanned, bool cancelled);
+    void openItem(QTreeWidgetItem *item);
+
+private:
+    FileSearch *search;
+    QLineEdit *patternEdit;
+    QLineEdit *directoryEdit;
+    QLineEdit *filterEdit;
+    QCheckBox *caseCheck;
+    QCheckBox *wordsCheck;
+    QPushButton *searchButton;
+    QTreeWidget *results;
+    QLabel *statusLabel;
+    QString searchedDirectory;
+    int matchCount;
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "linenumbertextedit.hpp"
+#include "textrange.hpp"
+#include "updatescheduler.hpp"
 #include <QTextDocument>
 #include <QPainter>
 #include <QAbstractTextDocumentLayout>
@@ -7,37 +9,71 @@
 #include <QUrl>
 #include <QInputDialog>
 #include <QMenu>
+#include <QWheelEvent>
+#include <QKeyEvent>
+#include <QSignalBlocker>
+#include <QCoreApplication>
+
+// Lines placed in the document in large file mode, and how close to its edges
+// the view may come before the window is moved
+static const int windowLines = 2000;
+static const int windowEdgeLines = 200;
 
 
 LineNumberTextEdit::LineNumberTextEdit(QWidget *parent)
-        : QTextEdit(parent)
+        : QTextEdit(parent), words(0), largeFile(false), windowFirstLine(0), windowStart(0), switchingWindow(false),
+          scheduler(nullptr), widthTask(-1), appliedWidth(-1)
 {
     lineNumberArea = new LineNumberArea(this);
+    lineScrollBar = new QScrollBar(Qt::Vertical, this);
+    lineScrollBar->setSingleStep(1);
+    lineScrollBar->hide();
+    connect(lineScrollBar, &QScrollBar::valueChanged, this, &LineNumberTextEdit::scrollToLine);
 
-    connect(this->document(), &QTextDocument::blockCountChanged, this, &LineNumberTextEdit::updateLineNumberAreaWidth);
+    connect(this->document(), &QTextDocument::blockCountChanged, this, &LineNumberTextEdit::scheduleLineNumberAreaWidth);
     connect(this, &QTextEdit::cursorPositionChanged, this, &LineNumberTextEdit::cursorPositionChangedSlot);
     connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &LineNumberTextEdit::onScrollBarValueChanged);
 
     updateLineNumberAreaWidth();
 
-    previousText = this->toPlainText();
+    // contentsChange comes before textChanged, the buffer is current in textChangedSlot
+    previousLineCount = buffer.lineCount();
+    connect(this->document(), &QTextDocument::contentsChange, this, &LineNumberTextEdit::documentContentsChange);
     connect(this, &QTextEdit::textChanged, this, &LineNumberTextEdit::textChangedSlot);
 }
 
 void LineNumberTextEdit::cursorPositionChangedSlot() {
+    // Keyboard moves past the window edges slide the window along
+    if (largeFile && !switchingWindow) {
+        const int line = currentLine();
+        if (!windowHolds(line, windowEdgeLines)) {
+            showWindow(line - windowLines / 2);
+            ensureCursorVisible();
+        }
+    }
+
     QRect rect = this->rect();
     int dy = this->verticalScrollBar()->value();
 
     updateLineNumberArea(rect, dy);
-    updateLineNumberAreaWidth();
+    scheduleLineNumberAreaWidth();
 }
 
 
 void LineNumberTextEdit::onScrollBarValueChanged(int value)
 {
     Q_UNUSED(value);
+    if (largeFile && !switchingWindow) {
+        const int top = firstLine() + cursorForPosition(QPoint(0, 0)).blockNumber();
+        if (!windowHolds(qMin(top + visibleLines(), buffer.lineCount() - 1), 0)) {
+            scrollToLine(top);
+            return;
+        }
+        const QSignalBlocker blocker(lineScrollBar);
+        lineScrollBar->setValue(top);
+    }
     updateLineNumberArea(QRect(), 0);
-    updateLineNumberAreaWidth();
+    scheduleLineNumberAreaWidth();
 }
 
 void LineNumberTextEdit::lineNumberAreaPaintEvent(QPaintEvent *event)
@@ -58,11 +94,11 @@ void LineNumberTextEdit::lineNumberAreaPaintEvent(QPaintEvent *event)
         if (bottom >= event->rect().top()) {
             QTextTable *table = cursor.currentTable();
             if (!table && !cursor.block().text().startsWith(QStringLiteral(" "))) {
-                QString number = QString::number(blockNumber + 1)+" ";
+                QString number = QString::number(windowFirstLine + blockNumber + 1)+" ";
                 painter.setPen(Qt::black);
                 painter.drawText(commentIconWidth, top, lineNumberArea->width() - commentIconWidth, fontMetrics().height(), Qt::AlignRight, number);
 
-                if (hasComment(blockNumber)) {
+                if (hasComment(windowFirstLine + blockNumber)) {
                     int commentIndicatorSize = fontMetrics().height() / 2;
                     QRect commentIndicatorRect(commentIconWidth / 2 - commentIndicatorSize / 2, top + commentIndicatorSize / 2, commentIndicatorSize, commentIndicatorSize);
                     painter.setBrush(Qt::black);
@@ -76,7 +112,7 @@ void LineNumberTextEdit::lineNumberAreaPaintEvent(QPaintEvent *event)
                 QTextCursor nextCursor(nextBlock);
                 QTextTable *nextTable = nextCursor.currentTable();
                 if (table != nextTable) {
-                    QString number = QString::number(blockNumber + 1)+" ";
+                    QString number = QString::number(windowFirstLine + blockNumber + 1)+" ";
                     painter.setPen(Qt::black);
                     painter.drawText(0, top, lineNumberArea->width(), fontMetrics().height(), Qt::AlignRight, number);
                 }
@@ -101,7 +137,7 @@ void LineNumberTextEdit::lineNumberAreaPaintEvent(QPaintEvent *event)
 int LineNumberTextEdit::lineNumberAreaWidth()
 {
     int digits = 1;
-    int max = qMax(1, this->document()->blockCount());
+    int max = qMax(1, lineCount());
     while (max >= 10) {
         max /= 10;
         ++digits;
@@ -118,17 +154,37 @@ void LineNumberTextEdit::resizeEvent(QResizeEvent *event)
     QRect cr = contentsRect();
     lineNumberArea->setGeometry(QRect(cr.left(), cr.top(), lineNumberAreaWidth(), cr.height()));
     lineNumberArea->update();
+    placeLineScrollBar();
 }
 
 
 void LineNumberTextEdit::setViewportMarginsPublic(int left, int top, int right, int bottom)
 {
-    setViewportMargins(left, top, right, bottom);
+    // The line scroll bar of large file mode sits in the right margin
+    setViewportMargins(left, top, right + (largeFile ? lineScrollBar->sizeHint().width() : 0), bottom);
+}
+
+void LineNumberTextEdit::setUpdateScheduler(UpdateScheduler *scheduler)
+{
+    this->scheduler = scheduler;
+    widthTask = scheduler->addTask([this]() { updateLineNumberAreaWidth(); });
+}
+
+void LineNumberTextEdit::scheduleLineNumberAreaWidth() {
+    if (scheduler)
+        scheduler->schedule(widthTask);
+    else
+        updateLineNumberAreaWidth();
 }
 
 void LineNumberTextEdit::updateLineNumberAreaWidth() {
     int lineNumberAreaWidthValue = lineNumberAreaWidth();
-    setViewportMargins(lineNumberAreaWidthValue, 0, 0, 0);
+    setViewportMarginsPublic(lineNumberAreaWidthValue, 0, 0, 0);
+    // New blocks take the margin of the block they split from, so the pass below is
+    // only needed for another digit, another font or a refilled document
+    if (lineNumberAreaWidthValue == appliedWidth)
+        return;
+    appliedWidth = lineNumberAreaWidthValue;
 
     QTextDocument *doc = document();
     QTextOption option = doc->defaultTextOption();
@@ -143,14 +199,17 @@ void LineNumberTextEdit::updateLineNumberAreaWidth() {
     blockFormat.setLeftMargin(lineNumberAreaWidthValue);
     QTextCursor cursor(doc);
 
+    // One change notification for the whole pass, and none for blocks already right
+    cursor.beginEditBlock();
     QTextBlock block = doc->begin();
     while (block.isValid()) {
         QTextCursor tempCursor(block);
-        if (!tempCursor.currentTable()) {
+        if (!tempCursor.currentTable() && block.blockFormat().leftMargin() != lineNumberAreaWidthValue) {
             tempCursor.setBlockFormat(blockFormat);
         }
         block = block.next();
     }
+    cursor.endEditBlock();
 }
 
 void LineNumberTextEdit::updateLineNumberArea(const QRect &rect, int dy) {
@@ -160,7 +219,7 @@ void LineNumberTextEdit::updateLineNumberArea(const QRect &rect, int dy) {
         lineNumberArea->update(0, rect.y(), lineNumberArea->width(), rect.height());
 
     if (rect.contains(viewport()->rect()))
-        updateLineNumberAreaWidth();
+        scheduleLineNumberAreaWidth();
     lineNumberArea->update(0, rect.y(), lineNumberArea->width(), rect.height());
 }
 
@@ -193,6 +252,17 @@ bool LineNumberTextEdit::hasComment(int lineNumber) const
     return comments.contains(lineNumber);
 }
 
+QMap<int, QString> LineNumberTextEdit::allComments() const
+{
+    return comments;
+}
+
+void LineNumberTextEdit::setComments(const QMap<int, QString> &comments)
+{
+    this->comments = comments;
+    lineNumberArea->update();
+}
+
 void LineNumberTextEdit::showCommentDialog(int lineNumber)
 {
     bool ok;
@@ -206,7 +276,7 @@ void LineNumberTextEdit::contextMenuEvent(QContextMenuEvent *event)
 {
     QPoint pos = event->pos();
     QTextCursor cursor = cursorForPosition(pos);
-    int lineNumber = cursor.blockNumber();
+    int lineNumber = windowFirstLine + cursor.blockNumber();
 
     QMenu menu(this);
     const QIcon addCommentIcon = QIcon("./images/add-comment.png");
@@ -255,15 +325,12 @@ void LineNumberTextEdit::contextMenuEvent(QContextMenuEvent *event)
 
 void LineNumberTextEdit::textChangedSlot()
 {
-    QString currentText = this->toPlainText();
-
-    int previousLineCount = previousText.count('\n');
-    int currentLineCount = currentText.count('\n');
+    int currentLineCount = buffer.lineCount();
     int lineOffset = currentLineCount - previousLineCount;
 
     QTextCursor cursor = this->textCursor();
     int position = cursor.position();
-    int insertDeleteLine = this->document()->findBlock(position).blockNumber();
+    int insertDeleteLine = windowFirstLine + this->document()->findBlock(position).blockNumber();
 
     QMap<int, QString> updatedComments;
     for (auto it = comments.begin(); it != comments.end(); ++it) {
@@ -280,10 +347,356 @@ void LineNumberTextEdit::textChangedSlot()
 
     comments = updatedComments;
     update();
-    previousText = currentText;
+    previousLineCount = currentLineCount;
 }
 
 QString LineNumberTextEdit::getComment(int lineNumber) const
 {
     return comments.value(lineNumber);
 }
+
+void LineNumberTextEdit::documentLoaded()
+{
+    if (largeFile) {
+        largeFile = false;
+        windowFirstLine = 0;
+        windowStart = 0;
+        lineScrollBar->hide();
+        setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+    }
+    buffer.setText(document()->toPlainText());
+    bufferUndo.clear();
+    bufferRedo.clear();
+    words = buffer.wordStarts(0, buffer.length());
+    previousLineCount = buffer.lineCount();
+    appliedWidth = -1;
+    updateLineNumberAreaWidth();
+    lineNumberArea->update();
+    emit documentRefilled();
+}
+
+const PieceTable &LineNumberTextEdit::textBuffer() const
+{
+    return buffer;
+}
+
+int LineNumberTextEdit::wordCount() const
+{
+    return words;
+}
+
+void LineNumberTextEdit::replaceBuffer(int position, int removed, const QString &added)
+{
+    // Only the word starts inside the edit and the one just after it can change
+    words -= buffer.wordStarts(position, position + removed + 1);
+    buffer.replace(position, removed, added);
+    words += buffer.wordStarts(position, position + added.size() + 1);
+}
+
+void LineNumberTextEdit::documentContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    if (switchingWindow)
+        return;
+
+    clampContentsChange(document(), position, &charsRemoved, &charsAdded);
+    const QString added = plainTextRange(document(), position, charsAdded);
+    position += windowStart;
+    // Format changes report the same range as removed and added, the text is unchanged
+    if (charsRemoved == added.size() && added == buffer.text(position, charsRemoved))
+        return;
+    replaceBuffer(position, charsRemoved, added);
+    if (largeFile) {
+        const QSignalBlocker blocker(lineScrollBar);
+        lineScrollBar->setMaximum(buffer.lineCount() - 1);
+    }
+    emit textBufferChanged(position, charsRemoved, added);
+}
+
+void LineNumberTextEdit::setLargeText(const QString &text)
+{
+    buffer.setText(text);
+    bufferUndo.clear();
+    bufferRedo.clear();
+    words = buffer.wordStarts(0, buffer.length());
+    previousLineCount = buffer.lineCount();
+    largeFile = true;
+    windowFirstLine = 0;
+    windowStart = 0;
+
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    {
+        const QSignalBlocker blocker(lineScrollBar);
+        lineScrollBar->setRange(0, buffer.lineCount() - 1);
+        lineScrollBar->setValue(0);
+    }
+    lineScrollBar->show();
+    placeLineScrollBar();
+
+    switchingWindow = true;
+    setTextCursor(QTextCursor(document()));
+    switchingWindow = false;
+    showWindow(0);
+    document()->setModified(false);
+}
+
+bool LineNumberTextEdit::isLargeFile() const
+{
+    return largeFile;
+}
+
+int LineNumberTextEdit::firstLine() const
+{
+    return windowFirstLine;
+}
+
+int LineNumberTextEdit::currentLine() const
+{
+    return windowFirstLine + textCursor().blockNumber();
+}
+
+int LineNumberTextEdit::lineCount() const
+{
+    return largeFile ? buffer.lineCount() : document()->blockCount();
+}
+
+/* Replace the document by the lines [firstLine, firstLine + windowLines) of the
+   buffer. The swap is not an edit: the buffer, the journal and the counters
+   do not hear about it, and the undo history restarts. */
+void LineNumberTextEdit::showWindow(int firstLine)
+{
+    const int lines = buffer.lineCount();
+    firstLine = qBound(0, firstLine, qMax(0, lines - windowLines));
+    const int lastLine = qMin(lines, firstLine + windowLines);
+    const int start = buffer.lineStart(firstLine);
+    // The '\n' ending the window stays outside, typing at its end must not cross it
+    const int end = lastLine < lines ? buffer.lineStart(lastLine) - 1 : buffer.length();
+
+    const QTextCursor oldCursor = textCursor();
+    const int anchor = windowStart + oldCursor.anchor();
+    const int position = windowStart + oldCursor.position();
+    const bool modified = document()->isModified();
+    // Edits on the document since the last batched replacement go with its history
+    if (document()->isUndoAvailable()) {
+        bufferUndo.clear();
+        bufferRedo.clear();
+    }
+
+    switchingWindow = true;
+    windowFirstLine = firstLine;
+    windowStart = start;
+    {
+        const QSignalBlocker blocker(document());
+        document()->setPlainText(buffer.text(start, end - start));
+        appliedWidth = -1;
+        updateLineNumberAreaWidth();
+        document()->clearUndoRedoStacks();
+        document()->setModified(modified);
+    }
+
+    QTextCursor cursor(document());
+    cursor.setPosition(qBound(0, anchor - start, end - start));
+    cursor.setPosition(qBound(0, position - start, end - start), QTextCursor::KeepAnchor);
+    setTextCursor(cursor);
+    switchingWindow = false;
+
+    viewport()->update();
+    lineNumberArea->update();
+    emit documentRefilled();
+}
+
+bool LineNumberTextEdit::windowHolds(int line, int margin) const
+{
+    const int lines = buffer.lineCount();
+    const int windowEnd = windowFirstLine + document()->blockCount();
+    // No margin is needed where the window already touches the start or end of the text
+    const int low = windowFirstLine > 0 ? windowFirstLine + margin : 0;
+    const int high = windowEnd < lines ? windowEnd - margin : lines;
+    return line >= low && line < high;
+}
+
+int LineNumberTextEdit::visibleLines() const
+{
+    return qMax(1, viewport()->height() / qMax(1, fontMetrics().lineSpacing()));
+}
+
+void LineNumberTextEdit::placeLineScrollBar()
+{
+    if (!largeFile)
+        return;
+    const QRect cr = contentsRect();
+    const int width = lineScrollBar->sizeHint().width();
+    const int height = cr.height() - (horizontalScrollBar()->isVisible() ? horizontalScrollBar()->height() : 0);
+    lineScrollBar->setGeometry(QRect(cr.right() - width + 1, cr.top(), width, height));
+    lineScrollBar->setPageStep(visibleLines());
+}
+
+void LineNumberTextEdit::scrollToLine(int line)
+{
+    if (!largeFile)
+        return;
+    line = qBound(0, line, buffer.lineCount() - 1);
+    const int bottom = qMin(line + visibleLines(), buffer.lineCount() - 1);
+    if (!windowHolds(line, windowEdgeLines) || !windowHolds(bottom, windowEdgeLines))
+        showWindow(line - windowLines / 2);
+
+    switchingWindow = true;
+    const QTextBlock block = document()->findBlockByNumber(line - windowFirstLine);
+    verticalScrollBar()->setValue(int(document()->documentLayout()->blockBoundingRect(block).top()));
+    {
+        const QSignalBlocker blocker(lineScrollBar);
+        lineScrollBar->setValue(line);
+    }
+    switchingWindow = false;
+    lineNumberArea->update();
+}
+
+void LineNumberTextEdit::wheelEvent(QWheelEvent *event)
+{
+    // The document scroll bar only spans the window, the line scroll bar spans the text
+    if (largeFile && !(event->modifiers() & Qt::ControlModifier)) {
+        QCoreApplication::sendEvent(lineScrollBar, event);
+        return;
+    }
+    QTextEdit::wheelEvent(event);
+}
+
+void LineNumberTextEdit::goToLine(int line)
+{
+    line = qBound(0, line, lineCount() - 1);
+    if (largeFile && !windowHolds(line, windowEdgeLines))
+        showWindow(line - windowLines / 2);
+
+    QTextCursor cursor(document()->findBlockByNumber(line - windowFirstLine));
+    setTextCursor(cursor);
+    ensureCursorVisible();
+}
+
+void LineNumberTextEdit::selectRange(int position, int length)
+{
+    position = qBound(0, position, buffer.length());
+    length = qBound(0, length, buffer.length() - position);
+    if (largeFile) {
+        const int line = buffer.lineAt(position);
+        const int lastLine = buffer.lineAt(position + length);
+        if (!windowHolds(line, 0) || !windowHolds(lastLine, 0))
+            showWindow(line - windowLines / 2);
+    }
+
+    const int windowLength = document()->characterCount() - 1;
+    QTextCursor cursor(document());
+    cursor.setPosition(qBound(0, position - windowStart, windowLength));
+    cursor.setPosition(qBound(0, position + length - windowStart, windowLength), QTextCursor::KeepAnchor);
+    setTextCursor(cursor);
+    ensureCursorVisible();
+}
+
+void LineNumberTextEdit::selectionRange(int *start, int *end) const
+{
+    const QTextCursor cursor = textCursor();
+    *start = windowStart + cursor.selectionStart();
+    *end = windowStart + cursor.selectionEnd();
+}
+
+void LineNumberTextEdit::visibleRange(int *start, int *end) const
+{
+    QTextCursor last = cursorForPosition(QPoint(viewport()->width() - 1, viewport()->height() - 1));
+    last.movePosition(QTextCursor::EndOfBlock);
+    *start = windowStart + cursorForPosition(QPoint(0, 0)).position();
+    *end = windowStart + last.position();
+}
+
+QTextCursor LineNumberTextEdit::cursorForRange(int position, int length) const
+{
+    const int windowLength = document()->characterCount() - 1;
+    if (position < windowStart || position + length > windowStart + windowLength)
+        return QTextCursor();
+    QTextCursor cursor(document());
+    cursor.setPosition(position - windowStart);
+    cursor.setPosition(position + length - windowStart, QTextCursor::KeepAnchor);
+    return cursor;
+}
+
+/* Applies the matches to the buffer from the last one back, then refills the window
+   once. Returns the replacements that undo them, in positions after the edit. */
+QVector<ReplaceMatch> LineNumberTextEdit::replaceInBuffer(const QVector<ReplaceMatch> &matches)
+{
+    QVector<ReplaceMatch> inverse;
+    inverse.reserve(matches.size());
+    int shift = 0;
+    // Edits wholly before the window move it, the view stays on the same lines
+    int windowShift = 0;
+    int windowLineShift = 0;
+    for (const ReplaceMatch &match : matches) {
+        const QString removed = buffer.text(match.start, match.length);
+        inverse.append({match.start + shift, match.replacement.size(), removed});
+        shift += match.replacement.size() - match.length;
+        if (match.start + match.length <= windowStart) {
+            windowShift += match.replacement.size() - match.length;
+            windowLineShift += match.replacement.count(QLatin1Char('\n')) - removed.count(QLatin1Char('\n'));
+        }
+    }
+
+    emit batchEditStarted(matches.size());
+    for (int i = matches.size() - 1; i >= 0; --i) {
+        const ReplaceMatch &match = matches.at(i);
+        replaceBuffer(match.start, match.length, match.replacement);
+        emit textBufferChanged(match.start, match.length, match.replacement);
+    }
+    windowStart += windowShift;
+    windowFirstLine += windowLineShift;
+    {
+        const QSignalBlocker blocker(lineScrollBar);
+        lineScrollBar->setMaximum(buffer.lineCount() - 1);
+    }
+    showWindow(windowFirstLine);
+    document()->setModified(true);
+    emit textChanged();
+    emit batchEditFinished();
+    return inverse;
+}
+
+void LineNumberTextEdit::replaceRanges(const QVector<ReplaceMatch> &matches)
+{
+    if (matches.isEmpty())
+        return;
+    // Assigned once the window is refilled, which drops the records with the document history
+    bufferUndo = replaceInBuffer(matches);
+    bufferRedo.clear();
+}
+
+void LineNumberTextEdit::undoEdit()
+{
+    // The record only matches the buffer once the document edits made since are undone
+    if (document()->isUndoAvailable() || bufferUndo.isEmpty()) {
+        undo();
+        return;
+    }
+    QVector<ReplaceMatch> matches;
+    matches.swap(bufferUndo);
+    bufferRedo = replaceInBuffer(matches);
+}
+
+void LineNumberTextEdit::redoEdit()
+{
+    if (document()->isUndoAvailable() || document()->isRedoAvailable() || bufferRedo.isEmpty()) {
+        redo();
+        return;
+    }
+    QVector<ReplaceMatch> matches;
+    matches.swap(bufferRedo);
+    bufferUndo = replaceInBuffer(matches);
+}
+
+void LineNumberTextEdit::keyPressEvent(QKeyEvent *event)
+{
+    // The shortcuts would go to the document's own stack, which lacks the batched edits
+    if (!isReadOnly() && event->matches(QKeySequence::Undo)) {
+        undoEdit();
+        return;
+    }
+    if (!isReadOnly() && event->matches(QKeySequence::Redo)) {
+        redoEdit();
+        return;
+    }
+    QTextEdit::keyPressEvent(event);
+}
@@ -4,8 +4,12 @@
 #include <QTextEdit>
 #include <QTextBlock>
 #include <QMap>
+#include "piecetable.hpp"
+#include "regexreplace.hpp"
 
 class LineNumberArea;
+class QScrollBar;
+class UpdateScheduler;
 
 class LineNumberTextEdit : public QTextEdit
 {
@@ -19,17 +23,58 @@ public:
     void setViewportMarginsPublic(int left, int top, int right, int bottom);
     /* Mettre à jour la zone de numéro de ligne */
     void updateLineNumberArea(const QRect &rect, int dy);
+    /* Les mises à jour de largeur demandées par les déplacements du curseur et le
+       défilement passent par scheduler, une fois par image ; sans lui elles sont immédiates */
+    void setUpdateScheduler(UpdateScheduler *scheduler);
 
     /* Commentaires */
     void addComment(int lineNumber, const QString& comment);
     void removeComment(int lineNumber);
     bool hasComment(int lineNumber) const;
     QString getComment(int lineNumber) const;
+    QMap<int, QString> allComments() const;
+    void setComments(const QMap<int, QString> &comments);
+
+    /* Resynchroniser après un chargement fait signaux bloqués */
+    void documentLoaded();
+    /* Texte brut du document, tenu à jour à chaque contentsChange */
+    const PieceTable &textBuffer() const;
+    /* Nombre de mots du texte entier, ajusté à chaque modification sur la seule zone modifiée */
+    int wordCount() const;
+
+    /* Mode grand fichier : le texte reste dans la table de morceaux, seules les lignes
+       autour de la zone visible sont dans le document, la barre de défilement suit les lignes.
+       Le texte décodé est gardé tel quel comme tampon d'origine (deux octets par caractère,
+       sans copie), jusqu'à PieceTable::maxLength caractères */
+    void setLargeText(const QString &text);
+    bool isLargeFile() const;
+    /* Ligne du texte entier affichée par le premier bloc du document */
+    int firstLine() const;
+    int currentLine() const;
+    int lineCount() const;
+    void goToLine(int line);
+    /* Sélection et remplacement en positions du texte entier */
+    void selectRange(int position, int length);
+    void selectionRange(int *start, int *end) const;
+    /* Partie du texte entier affichée à l'écran */
+    void visibleRange(int *start, int *end) const;
+    /* Curseur du document sur une plage du texte entier, nul si elle sort de la fenêtre */
+    QTextCursor cursorForRange(int position, int length) const;
+    /* Mode grand fichier : remplacements triés et disjoints, en positions du texte entier,
+       faits sur le tampon en une passe puis la fenêtre remplie une fois. Un seul
+       undoEdit() les défait tous */
+    void replaceRanges(const QVector<ReplaceMatch> &matches);
+    /* Annuler et rétablir : la pile du document, puis le dernier remplacement groupé,
+       qui n'y figure pas */
+    void undoEdit();
+    void redoEdit();
 
 protected:
     /* Gérer le redimensionnement des numéros si augmentation/reduction de la window */
     void resizeEvent(QResizeEvent *event) override;
     void mousePressEvent(QMouseEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
 
     void contextMenuEvent(QContextMenuEvent *event) override;
 
@@ -38,22 +83,58 @@ public slots:
     void textChangedSlot();
 
 private slots:
-    /* Mettre à jour la largeur de la zone de numéro de ligne */
+    /* Mettre à jour la largeur de la zone de numéro de ligne. L'option de texte, qui
+       relance la mise en page de tout le document, et les marges des blocs ne sont
+       touchées que si la largeur a changé ou si le document vient d'être rempli */
     void updateLineNumberAreaWidth();
+    void scheduleLineNumberAreaWidth();
     void onScrollBarValueChanged(int value);
     void cursorPositionChangedSlot();
+    void documentContentsChange(int position, int charsRemoved, int charsAdded);
+    void scrollToLine(int line);
 
 private:
+    void showWindow(int firstLine);
+    bool windowHolds(int line, int margin) const;
+    int visibleLines() const;
+    void placeLineScrollBar();
+    void replaceBuffer(int position, int removed, const QString &added);
+    QVector<ReplaceMatch> replaceInBuffer(const QVector<ReplaceMatch> &matches);
+
     /* Zone de numéro de ligne */
     LineNumberArea *lineNumberArea;
     /* Map pour les commentaires */
     QMap<int, QString> comments;
-    QString previousText;
+    PieceTable buffer;
+    int words;
+    int previousLineCount;
+    QScrollBar *lineScrollBar;
+    bool largeFile;
+    /* Première ligne et position dans le texte entier du début du document */
+    int windowFirstLine;
+    int windowStart;
+    bool switchingWindow;
+    UpdateScheduler *scheduler;
+    int widthTask;
+    /* Largeur appliquée aux blocs, -1 pour forcer le prochain passage */
+    int appliedWidth;
+    /* Remplacements qui défont le dernier remplacement groupé, ou le refont après
+       undoEdit(). Valables tant que la pile d'annulation du document est vide */
+    QVector<ReplaceMatch> bufferUndo;
+    QVector<ReplaceMatch> bufferRedo;
 
 signals:
     void linkClicked(const QUrl &url);
     void showComment(const QString &comment);
     void commentChanged();
+    /* Le texte brut a changé, en positions du texte entier */
+    void textBufferChanged(int position, int charsRemoved, const QString &added);
+    /* Le document a été rempli signaux bloqués : chargement ou fenêtre déplacée */
+    void documentRefilled();
+    /* Remplacements groupés sur le tampon : suivis de edits signaux textBufferChanged,
+       puis de batchEditFinished() */
+    void batchEditStarted(int edits);
+    void batchEditFinished();
 };
 
 
@@ -0,0 +1,185 @@
+#include "literalsearch.hpp"
+#include "cpufeatures.hpp"
+#include <cstring>
+#ifdef OA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static inline ushort foldCase(ushort c)
+{
+    if (c < 0x80)
+        return c >= 'A' && c <= 'Z' ? ushort(c + 32) : c;
+    return QChar(c).toCaseFolded().unicode();
+}
+
+/* Every UTF-16 unit that folds to the same character as c, when they are all known:
+   ASCII letters, plus the two non-ASCII letters that fold into ASCII */
+static bool foldVariants(ushort c, LiteralMatcher::Variants *variants)
+{
+    const ushort lower = foldCase(c);
+    if (lower >= 0x80)
+        return false;
+    ushort extra = lower;
+    if (lower == 'k')
+        extra = 0x212a; // KELVIN SIGN
+    else if (lower == 's')
+        extra = 0x017f; // LATIN SMALL LETTER LONG S
+    const ushort upper = lower >= 'a' && lower <= 'z' ? ushort(lower - 32) : lower;
+    *variants = {{lower, upper, extra}};
+    return true;
+}
+
+LiteralMatcher::LiteralMatcher(const QString &pattern, Qt::CaseSensitivity caseSensitivity)
+        : caseSensitivity(caseSensitivity), vectorFilter(false) {
+    folded.reserve(pattern.size());
+    for (const QChar c : pattern)
+        folded.append(caseSensitivity == Qt::CaseSensitive ? c.unicode() : foldCase(c.unicode()));
+
+    const int m = folded.size();
+    if (m > 0) {
+        if (caseSensitivity == Qt::CaseSensitive) {
+            first = {{folded.first(), folded.first(), folded.first()}};
+            last = {{folded.last(), folded.last(), folded.last()}};
+            vectorFilter = true;
+        } else {
+            vectorFilter = foldVariants(folded.first(), &first) && foldVariants(folded.last(), &last);
+        }
+    }
+
+    // Horspool on the low byte of the folded character: equal characters share it
+    for (int &shift : shifts)
+        shift = qMax(m, 1);
+    for (int j = 0; j < m - 1; ++j)
+        shifts[folded.at(j) & 0xff] = m - 1 - j;
+}
+
+int LiteralMatcher::size() const {
+    return folded.size();
+}
+
+bool LiteralMatcher::matchesAt(const ushort *text) const {
+    const int m = folded.size();
+    if (caseSensitivity == Qt::CaseSensitive)
+        return std::memcmp(text, folded.constData(), size_t(m) * sizeof(ushort)) == 0;
+    for (int k = 0; k < m; ++k) {
+        if (text[k] != folded.at(k) && foldCase(text[k]) != folded.at(k))
+            return false;
+    }
+    return true;
+}
+
+int LiteralMatcher::horspool(const ushort *text, int length, int from) const {
+    const int m = folded.size();
+    const ushort final = folded.at(m - 1);
+    const bool sensitive = caseSensitivity == Qt::CaseSensitive;
+    for (int i = from; i <= length - m;) {
+        const ushort c = sensitive ? text[i + m - 1] : foldCase(text[i + m - 1]);
+        if (c == final && matchesAt(text + i))
+            return i;
+        i += shifts[c & 0xff];
+    }
+    return -1;
+}
+
+#ifdef OA_X86_SIMD
+
+/* Candidates are the positions whose first character matches the pattern's first and
+   whose character m - 1 further matches its last, 8 or 16 positions per step. The
+   masks hold two bits per position, as _mm_movemask_epi8 leaves them */
+
+static inline __m128i equalsAny(__m128i chars, const __m128i *variants)
+{
+    return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chars, variants[0]), _mm_cmpeq_epi16(chars, variants[1])),
+                        _mm_cmpeq_epi16(chars, variants[2]));
+}
+
+template <typename Verify>
+static int filterSse2(const ushort *text, int length, int from, int m, const LiteralMatcher::Variants &first,
+                      const LiteralMatcher::Variants &last, const Verify &verify)
+{
+    const __m128i firsts[3] = {_mm_set1_epi16(short(first.units[0])), _mm_set1_epi16(short(first.units[1])),
+                               _mm_set1_epi16(short(first.units[2]))};
+    const __m128i lasts[3] = {_mm_set1_epi16(short(last.units[0])), _mm_set1_epi16(short(last.units[1])),
+                              _mm_set1_epi16(short(last.units[2]))};
+    int i = from;
+    for (; i <= length - m - 7; i += 8) {
+        const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i + m - 1));
+        quint32 mask = quint32(_mm_movemask_epi8(_mm_and_si128(equalsAny(head, firsts), equalsAny(tail, lasts))));
+        while (mask) {
+            const int bit = qCountTrailingZeroBits(mask);
+            if (verify(i + bit / 2))
+                return i + bit / 2;
+            mask &= ~(quint32(3) << bit);
+        }
+    }
+    return i;
+}
+
+OA_TARGET_AVX2 static inline __m256i equalsAny(__m256i chars, const __m256i *variants)
+{
+    return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(chars, variants[0]),
+                                           _mm256_cmpeq_epi16(chars, variants[1])),
+                           _mm256_cmpeq_epi16(chars, variants[2]));
+}
+
+template <typename Verify>
+OA_TARGET_AVX2 static int filterAvx2(const ushort *text, int length, int from, int m,
+                                     const LiteralMatcher::Variants &first, const LiteralMatcher::Variants &last,
+                                     const Verify &verify)
+{
+    const __m256i firsts[3] = {_mm256_set1_epi16(short(first.units[0])), _mm256_set1_epi16(short(first.units[1])),
+                               _mm256_set1_epi16(short(first.units[2]))};
+    const __m256i lasts[3] = {_mm256_set1_epi16(short(last.units[0])), _mm256_set1_epi16(short(last.units[1])),
+                              _mm256_set1_epi16(short(last.units[2]))};
+    int i = from;
+    for (; i <= length - m - 15; i += 16) {
+        const __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+        const __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i + m - 1));
+        quint32 mask = quint32(_mm256_movemask_epi8(_mm256_and_si256(equalsAny(head, firsts),
+                                                                     equalsAny(tail, lasts))));
+        while (mask) {
+            const int bit = qCountTrailingZeroBits(mask);
+            if (verify(i + bit / 2))
+                return i + bit / 2;
+            mask &= ~(quint32(3) << bit);
+        }
+    }
+    return i;
+}
+
+#endif
+
+int LiteralMatcher::indexIn(const QChar *data, int length, int from) const {
+    const int m = folded.size();
+    if (m == 0 || from < 0 || from > length - m)
+        return -1;
+    const ushort *text = reinterpret_cast<const ushort *>(data);
+#ifdef OA_X86_SIMD
+    if (vectorFilter) {
+        // The kernels stop at the first verified candidate, or where fewer positions
+        // are left than a vector holds
+        int found = -1;
+        const auto verify = [&](int i) {
+            if (!matchesAt(text + i))
+                return false;
+            found = i;
+            return true;
+        };
+        const int stopped = cpuHasAvx2() ? filterAvx2(text, length, from, m, first, last, verify)
+                                         : filterSse2(text, length, from, m, first, last, verify);
+        if (found >= 0)
+            return found;
+        for (int i = stopped; i <= length - m; ++i) {
+            if (matchesAt(text + i))
+                return i;
+        }
+        return -1;
+    }
+#endif
+    return horspool(text, length, from);
+}
+
+int LiteralMatcher::indexIn(const QString &text, int from) const {
+    return indexIn(text.constData(), text.size(), from);
+}
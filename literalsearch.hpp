@@ -0,0 +1,40 @@
+#ifndef LITERALSEARCH_HPP
+#define LITERALSEARCH_HPP
+
+#include <QString>
+#include <QVector>
+
+/* Recherche d'un motif littéral dans du texte UTF-16. Les positions candidates sont
+   filtrées par comparaison vectorielle du premier et du dernier caractère du motif
+   (AVX2 si disponible, sinon SSE2), puis vérifiées ; sans filtre possible (motif non
+   ASCII en casse ignorée, processeur non x86), Horspool sur les caractères repliés.
+   La casse ignorée suit QChar::toCaseFolded, comme QString::indexOf */
+class LiteralMatcher
+{
+public:
+    LiteralMatcher(const QString &pattern, Qt::CaseSensitivity caseSensitivity);
+
+    /* Première occurrence qui commence dans data[from, length), -1 sinon */
+    int indexIn(const QChar *data, int length, int from) const;
+    int indexIn(const QString &text, int from) const;
+    int size() const;
+
+    /* Caractères du texte qui correspondent à un caractère du motif, au plus trois */
+    struct Variants
+    {
+        ushort units[3];
+    };
+
+private:
+    bool matchesAt(const ushort *text) const;
+    int horspool(const ushort *text, int length, int from) const;
+
+    QVector<ushort> folded;
+    Qt::CaseSensitivity caseSensitivity;
+    bool vectorFilter;
+    Variants first;
+    Variants last;
+    int shifts[256];
+};
+
+#endif
@@ -23,7 +23,8 @@ int main(int argc, char *argv[])
     parser.process(app);
 
     MainWindow mainWin;
-    if (!parser.positionalArguments().isEmpty())
+    // Offer to replay the edit journal left behind by a crash
+    if (!mainWin.restoreFromJournal() && !parser.positionalArguments().isEmpty())
         mainWin.loadFile(parser.positionalArguments().first());
     mainWin.show();
     return app.exec();
@@ -1,18 +1,62 @@
 TEMPLATE = app
 TARGET = window
-QT += core gui widgets
+QT += core gui widgets concurrent
 
 SOURCES += \
     window.cpp \
     main.cpp \
-    linenumbertextedit.cpp
+    linenumbertextedit.cpp \
+    fileloader.cpp \
+    filesaver.cpp \
+    textrange.cpp \
+    editjournal.cpp \
+    nativeformat.cpp \
+    piecetable.cpp \
+    cpufeatures.cpp \
+    textencoding.cpp \
+    compression.cpp \
+    wordcount.cpp \
+    updatescheduler.cpp \
+    documentstatistics.cpp \
+    textsearch.cpp \
+    findbar.cpp \
+    trigramindex.cpp \
+    filesearch.cpp \
+    findinfiles.cpp \
+    regexreplace.cpp \
+    literalsearch.cpp \
+    batchreplace.cpp \
+    spellhighlighter.cpp \
+    spellcache.cpp
 
 HEADERS += \
     window.hpp \
-    linenumbertextedit.hpp
+    linenumbertextedit.hpp \
+    fileloader.hpp \
+    filesaver.hpp \
+    textrange.hpp \
+    editjournal.hpp \
+    nativeformat.hpp \
+    piecetable.hpp \
+    cpufeatures.hpp \
+    textencoding.hpp \
+    compression.hpp \
+    wordcount.hpp \
+    updatescheduler.hpp \
+    documentstatistics.hpp \
+    textsearch.hpp \
+    findbar.hpp \
+    trigramindex.hpp \
+    filesearch.hpp \
+    findinfiles.hpp \
+    regexreplace.hpp \
+    literalsearch.hpp \
+    batchreplace.hpp \
+    spellhighlighter.hpp \
+    spellcache.hpp
 
 RESOURCES += application.qrc
 
-LIBS += -lhunspell-1.7
+LIBS += -lhunspell-1.7 -lz -lzstd
 
 INCLUDEPATH += /usr/share/hunspell
@@ -0,0 +1,338 @@
+#include "nativeformat.hpp"
+#include <QIODevice>
+#include <QBuffer>
+#include <QDataStream>
+#include <QFileInfo>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTextFrame>
+#include <QTextTable>
+#include <QImage>
+#include <QUrl>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QStack>
+#include <QVarLengthArray>
+
+/* File layout: magic and version, then a stream of chunks, each one
+   [type: quint8][length: quint32][payload] so unknown chunks can be skipped.
+   Formats and images are emitted right before the first chunk that uses them. */
+static const quint32 nativeMagic = 0x4f414446; // "OADF"
+static const quint16 nativeVersion = 1;
+
+enum ChunkType : quint8 {
+    FormatChunk = 1,    // id, QTextFormat
+    ImageChunk,         // resource name, PNG data
+    BlockChunk,         // block format id, block char format id, fragments (format id, text)
+    TableBeginChunk,    // table format id, rows, columns
+    CellChunk,          // row, column, row span, column span, cell format id
+    TableEndChunk,
+    CommentsChunk,      // QMap<int, QString> of the line number area
+    EndChunk
+};
+
+class NativeWriter
+{
+public:
+    NativeWriter(QIODevice *device, const QTextDocument *document) : device(device), document(document) {}
+
+    bool write(const QMap<int, QString> &comments) {
+        QDataStream header(device);
+        header << nativeMagic << nativeVersion;
+
+        writeFrame(document->rootFrame()->begin());
+
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out << comments;
+        writeChunk(CommentsChunk, payload);
+        writeChunk(EndChunk, QByteArray());
+        return ok && header.status() == QDataStream::Ok;
+    }
+
+private:
+    void writeChunk(ChunkType type, const QByteArray &payload) {
+        QDataStream out(device);
+        out << quint8(type) << quint32(payload.size());
+        if (out.status() != QDataStream::Ok || device->write(payload) != payload.size())
+            ok = false;
+    }
+
+    /* The document already shares identical formats, its index is the dedup key */
+    quint32 formatId(const QTextFormat &format, int documentIndex) {
+        const auto it = formatIds.constFind(documentIndex);
+        if (it != formatIds.constEnd())
+            return it.value();
+
+        const quint32 id = quint32(formatIds.size());
+        formatIds.insert(documentIndex, id);
+        if (format.isImageFormat())
+            writeImage(format.toImageFormat().name());
+
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out << id << format;
+        writeChunk(FormatChunk, payload);
+        return id;
+    }
+
+    void writeImage(const QString &name) {
+        if (name.isEmpty() || images.contains(name))
+            return;
+        images.insert(name);
+
+        const QVariant resource = document->resource(QTextDocument::ImageResource, QUrl(name));
+        QImage image = resource.value<QImage>();
+        if (image.isNull() && resource.type() == QVariant::ByteArray)
+            image = QImage::fromData(resource.toByteArray());
+        if (image.isNull())
+            return;
+
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+
+        QByteArray payload;
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out << name << png;
+        writeChunk(ImageChunk, payload);
+    }
+
+    /* Plain child frames are flattened, tables keep their structure */
+    void writeFrame(QTextFrame::iterator it) {
+        for (; ok && !it.atEnd(); ++it) {
+            if (QTextFrame *frame = it.currentFrame()) {
+                if (QTextTable *table = qobject_cast<QTextTable *>(frame))
+                    writeTable(table);
+                else
+                    writeFrame(frame->begin());
+            } else if (it.currentBlock().isValid()) {
+                writeBlock(it.currentBlock());
+            }
+        }
+    }
+
+    void writeBlock(const QTextBlock &block) {
+        const quint32 blockFormat = formatId(block.blockFormat(), block.blockFormatIndex());
+        const quint32 blockCharFormat = formatId(block.charFormat(), block.charFormatIndex());
+
+        QVarLengthArray<QTextFragment, 16> fragments;
+        QVarLengthArray<quint32, 16> fragmentFormats;
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            fragments.append(fragment);
+            fragmentFormats.append(formatId(fragment.charFormat(), fragment.charFormatIndex()));
+        }
+
+        chunk.resize(0);
+        QDataStream out(&chunk, QIODevice::WriteOnly);
+        out << blockFormat << blockCharFormat << quint32(fragments.size());
+        for (int i = 0; i < fragments.size(); ++i)
+            out << fragmentFormats[i] << fragments[i].text();
+        writeChunk(BlockChunk, chunk);
+    }
+
+    void writeTable(QTextTable *table) {
+        QByteArray payload;
+        {
+            QDataStream out(&payload, QIODevice::WriteOnly);
+            // The object index ties the format to this document's table, a new one is made on load
+            QTextTableFormat tableFormat = table->format();
+            tableFormat.setObjectIndex(-1);
+            out << formatId(tableFormat, table->formatIndex())
+                << quint32(table->rows()) << quint32(table->columns());
+        }
+        writeChunk(TableBeginChunk, payload);
+
+        for (int row = 0; row < table->rows(); ++row) {
+            for (int column = 0; column < table->columns(); ++column) {
+                const QTextTableCell cell = table->cellAt(row, column);
+                // Cells covered by a span are written once, at their top-left corner
+                if (cell.row() != row || cell.column() != column)
+                    continue;
+
+                const quint32 cellFormat = formatId(cell.format(), cell.tableCellFormatIndex());
+                payload.resize(0);
+                QDataStream out(&payload, QIODevice::WriteOnly);
+                out << quint32(row) << quint32(column) << quint32(cell.rowSpan())
+                    << quint32(cell.columnSpan()) << cellFormat;
+                writeChunk(CellChunk, payload);
+                writeFrame(cell.begin());
+            }
+        }
+        writeChunk(TableEndChunk, QByteArray());
+    }
+
+    QIODevice *device;
+    const QTextDocument *document;
+    QHash<int, quint32> formatIds;
+    QSet<QString> images;
+    QByteArray chunk;
+    bool ok = true;
+};
+
+class NativeReader
+{
+public:
+    NativeReader(QIODevice *device, QTextDocument *document) : device(device), document(document) {}
+
+    bool read(QMap<int, QString> *comments, QString *errorString) {
+        QDataStream in(device);
+        quint32 magic = 0;
+        quint16 version = 0;
+        in >> magic >> version;
+        if (magic != nativeMagic || version > nativeVersion) {
+            *errorString = QObject::tr("Not an Office Application document");
+            return false;
+        }
+
+        document->clear();
+        cursor = QTextCursor(document);
+        cursor.beginEditBlock();
+        bool ended = false;
+        while (!ended && in.status() == QDataStream::Ok) {
+            quint8 type = 0;
+            quint32 length = 0;
+            in >> type >> length;
+            const QByteArray payload = device->read(length);
+            if (in.status() != QDataStream::Ok || quint32(payload.size()) != length)
+                break;
+
+            QDataStream chunk(payload);
+            switch (type) {
+                case FormatChunk: readFormat(chunk); break;
+                case ImageChunk: readImage(chunk); break;
+                case BlockChunk: readBlock(chunk); break;
+                case TableBeginChunk: readTableBegin(chunk); break;
+                case CellChunk: readCell(chunk); break;
+                case TableEndChunk: readTableEnd(); break;
+                case CommentsChunk: chunk >> *comments; break;
+                case EndChunk: ended = true; break;
+                default: break;
+            }
+        }
+        cursor.endEditBlock();
+
+        if (!ended) {
+            *errorString = QObject::tr("The document is truncated or damaged");
+            return false;
+        }
+        return true;
+    }
+
+private:
+    QTextFormat format(quint32 id) const {
+        return id < quint32(formats.size()) ? formats.at(int(id)) : QTextFormat();
+    }
+
+    void readFormat(QDataStream &in) {
+        quint32 id;
+        QTextFormat textFormat;
+        in >> id >> textFormat;
+        if (id >= quint32(formats.size()))
+            formats.resize(int(id) + 1);
+        formats[int(id)] = textFormat;
+    }
+
+    void readImage(QDataStream &in) {
+        QString name;
+        QByteArray png;
+        in >> name >> png;
+        document->addResource(QTextDocument::ImageResource, QUrl(name), QImage::fromData(png, "PNG"));
+    }
+
+    void readBlock(QDataStream &in) {
+        quint32 blockFormat, blockCharFormat, count;
+        in >> blockFormat >> blockCharFormat >> count;
+
+        // The first block of the document, of a cell or after a table already exists
+        if (atContextStart) {
+            cursor.setBlockFormat(format(blockFormat).toBlockFormat());
+            cursor.setBlockCharFormat(format(blockCharFormat).toCharFormat());
+            atContextStart = false;
+        } else {
+            cursor.insertBlock(format(blockFormat).toBlockFormat(), format(blockCharFormat).toCharFormat());
+        }
+
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+            quint32 id;
+            QString text;
+            in >> id >> text;
+            const QTextCharFormat charFormat = format(id).toCharFormat();
+            if (!charFormat.isImageFormat()) {
+                cursor.insertText(text, charFormat);
+                continue;
+            }
+            for (const QChar ch : text) {
+                if (ch == QChar::ObjectReplacementCharacter)
+                    cursor.insertImage(charFormat.toImageFormat());
+                else
+                    cursor.insertText(QString(ch), charFormat);
+            }
+        }
+    }
+
+    void readTableBegin(QDataStream &in) {
+        quint32 tableFormat, rows, columns;
+        in >> tableFormat >> rows >> columns;
+        if (rows == 0 || columns == 0)
+            return;
+        tables.push(cursor.insertTable(int(rows), int(columns), format(tableFormat).toTableFormat()));
+    }
+
+    void readCell(QDataStream &in) {
+        quint32 row, column, rowSpan, columnSpan, cellFormat;
+        in >> row >> column >> rowSpan >> columnSpan >> cellFormat;
+        if (tables.isEmpty())
+            return;
+
+        QTextTable *table = tables.top();
+        if (rowSpan > 1 || columnSpan > 1)
+            table->mergeCells(int(row), int(column), int(rowSpan), int(columnSpan));
+        QTextTableCell cell = table->cellAt(int(row), int(column));
+        if (!cell.isValid())
+            return;
+        cell.setFormat(format(cellFormat).toCharFormat());
+        cursor = cell.firstCursorPosition();
+        atContextStart = true;
+    }
+
+    void readTableEnd() {
+        if (tables.isEmpty())
+            return;
+        QTextTable *table = tables.pop();
+        cursor = table->lastCursorPosition();
+        cursor.movePosition(QTextCursor::NextBlock);
+        atContextStart = true;
+    }
+
+    QIODevice *device;
+    QTextDocument *document;
+    QTextCursor cursor;
+    QVector<QTextFormat> formats;
+    QStack<QTextTable *> tables;
+    bool atContextStart = true;
+};
+
+bool NativeFormat::isNativeFile(const QString &fileName) {
+    return QFileInfo(fileName).suffix().compare(QLatin1String("oad"), Qt::CaseInsensitive) == 0;
+}
+
+bool NativeFormat::write(QIODevice *device, const QTextDocument *document,
+                         const QMap<int, QString> &comments, QString *errorString) {
+    NativeWriter writer(device, document);
+    if (!writer.write(comments)) {
+        *errorString = device->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool NativeFormat::read(QIODevice *device, QTextDocument *document,
+                        QMap<int, QString> *comments, QString *errorString) {
+    NativeReader reader(device, document);
+    return reader.read(comments, errorString);
+}
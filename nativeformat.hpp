@@ -0,0 +1,23 @@
+#ifndef NATIVEFORMAT_HPP
+#define NATIVEFORMAT_HPP
+
+#include <QString>
+#include <QMap>
+
+class QIODevice;
+class QTextDocument;
+
+/* Format binaire natif (.oad) : le document est écrit bloc par bloc avec une table
+   de formats dédupliquée, les images dans leurs propres morceaux et les commentaires */
+class NativeFormat
+{
+public:
+    static bool isNativeFile(const QString &fileName);
+
+    static bool write(QIODevice *device, const QTextDocument *document,
+                      const QMap<int, QString> &comments, QString *errorString);
+    static bool read(QIODevice *device, QTextDocument *document,
+                     QMap<int, QString> *comments, QString *errorString);
+};
+
+#endif
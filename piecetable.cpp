@@ -0,0 +1,371 @@
+#include "piecetable.hpp"
+#include "wordcount.hpp"
+#include <algorithm>
+
+// Typed text is appended to buffers of this size; longer insertions get their own
+static const int appendBufferChars = 64 * 1024;
+
+const int PieceTable::maxLength;
+
+struct PieceTable::Node
+{
+    int buffer;
+    int start;
+    int length;
+    int newlines;
+    quint32 priority;
+    // Sums over the subtree, the implicit keys of the treap
+    int totalLength;
+    int totalNewlines;
+    Node *left;
+    Node *right;
+};
+
+static void indexNewlines(const QChar *data, int length, int offset, QVector<int> *newlines)
+{
+    for (int i = 0; i < length; ++i) {
+        if (data[i] == QLatin1Char('\n'))
+            newlines->append(offset + i);
+    }
+}
+
+PieceTable::PieceTable() : appendBuffer(-1), root(nullptr), seed(0x9e3779b9) {}
+
+PieceTable::~PieceTable() {
+    destroy(root);
+}
+
+PieceTable::Node *PieceTable::newNode(int buffer, int start, int length) {
+    // xorshift32, the priorities only need to look random to keep the tree balanced
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    Node *node = new Node;
+    node->buffer = buffer;
+    node->start = start;
+    node->length = length;
+    node->newlines = newlinesIn(buffer, start, length);
+    node->priority = seed;
+    node->left = nullptr;
+    node->right = nullptr;
+    update(node);
+    return node;
+}
+
+void PieceTable::update(Node *node) const {
+    node->totalLength = node->length;
+    node->totalNewlines = node->newlines;
+    if (node->left) {
+        node->totalLength += node->left->totalLength;
+        node->totalNewlines += node->left->totalNewlines;
+    }
+    if (node->right) {
+        node->totalLength += node->right->totalLength;
+        node->totalNewlines += node->right->totalNewlines;
+    }
+}
+
+int PieceTable::newlinesIn(int buffer, int start, int length) const {
+    const QVector<int> &newlines = buffers.at(buffer).newlines;
+    return int(std::lower_bound(newlines.begin(), newlines.end(), start + length)
+               - std::lower_bound(newlines.begin(), newlines.end(), start));
+}
+
+void PieceTable::split(Node *node, int position, Node *&left, Node *&right) {
+    if (!node) {
+        left = right = nullptr;
+        return;
+    }
+
+    const int leftLength = node->left ? node->left->totalLength : 0;
+    if (position <= leftLength) {
+        split(node->left, position, left, node->left);
+        update(node);
+        right = node;
+    } else if (position >= leftLength + node->length) {
+        split(node->right, position - leftLength - node->length, node->right, right);
+        update(node);
+        left = node;
+    } else {
+        // The position falls inside this piece, cut it in two
+        const int offset = position - leftLength;
+        Node *tail = newNode(node->buffer, node->start + offset, node->length - offset);
+        node->length = offset;
+        node->newlines -= tail->newlines;
+        Node *rest = node->right;
+        node->right = nullptr;
+        update(node);
+        left = node;
+        right = merge(tail, rest);
+    }
+}
+
+PieceTable::Node *PieceTable::merge(Node *left, Node *right) {
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+    if (left->priority > right->priority) {
+        left->right = merge(left->right, right);
+        update(left);
+        return left;
+    }
+    right->left = merge(left, right->left);
+    update(right);
+    return right;
+}
+
+/* Typing appends to the buffer right after the previous keystroke, so the last
+   piece usually just grows instead of adding a node per character. */
+bool PieceTable::extendLast(Node *node, int buffer, int start, int length, int newlines) {
+    if (!node)
+        return false;
+    if (node->right) {
+        if (!extendLast(node->right, buffer, start, length, newlines))
+            return false;
+    } else if (node->buffer == buffer && node->start + node->length == start) {
+        node->length += length;
+        node->newlines += newlines;
+    } else {
+        return false;
+    }
+    update(node);
+    return true;
+}
+
+void PieceTable::destroy(Node *node) {
+    if (!node)
+        return;
+    destroy(node->left);
+    destroy(node->right);
+    delete node;
+}
+
+void PieceTable::append(const QString &added, int *buffer, int *start) {
+    if (added.size() > appendBufferChars / 4) {
+        Buffer large;
+        large.text = added;
+        indexNewlines(added.constData(), added.size(), 0, &large.newlines);
+        buffers.append(large);
+        *buffer = buffers.size() - 1;
+        *start = 0;
+        return;
+    }
+
+    if (appendBuffer < 0 || buffers.at(appendBuffer).text.size() + added.size() > appendBufferChars) {
+        buffers.append(Buffer());
+        appendBuffer = buffers.size() - 1;
+        buffers[appendBuffer].text.reserve(appendBufferChars);
+    }
+    Buffer &target = buffers[appendBuffer];
+    *buffer = appendBuffer;
+    *start = target.text.size();
+    indexNewlines(added.constData(), added.size(), *start, &target.newlines);
+    target.text += added;
+}
+
+void PieceTable::setText(const QString &text) {
+    destroy(root);
+    root = nullptr;
+    buffers.clear();
+    appendBuffer = -1;
+    if (text.isEmpty())
+        return;
+
+    Buffer original;
+    original.text = text;
+    indexNewlines(text.constData(), text.size(), 0, &original.newlines);
+    buffers.append(original);
+    root = newNode(0, 0, text.size());
+}
+
+void PieceTable::replace(int position, int removed, const QString &added) {
+    position = qBound(0, position, length());
+    removed = qBound(0, removed, length() - position);
+
+    Node *left, *middle, *right;
+    split(root, position, left, middle);
+    split(middle, removed, middle, right);
+    destroy(middle);
+
+    if (!added.isEmpty()) {
+        int buffer, start;
+        append(added, &buffer, &start);
+        const int newlines = newlinesIn(buffer, start, added.size());
+        if (!extendLast(left, buffer, start, added.size(), newlines))
+            left = merge(left, newNode(buffer, start, added.size()));
+    }
+    root = merge(left, right);
+}
+
+int PieceTable::length() const {
+    return root ? root->totalLength : 0;
+}
+
+int PieceTable::lineCount() const {
+    return (root ? root->totalNewlines : 0) + 1;
+}
+
+int PieceTable::chunkAt(int position, const QChar **data) const {
+    const Node *node = root;
+    while (node) {
+        const int leftLength = node->left ? node->left->totalLength : 0;
+        if (position < leftLength) {
+            node = node->left;
+        } else if (position < leftLength + node->length) {
+            const int offset = position - leftLength;
+            *data = buffers.at(node->buffer).text.constData() + node->start + offset;
+            return node->length - offset;
+        } else {
+            position -= leftLength + node->length;
+            node = node->right;
+        }
+    }
+    *data = nullptr;
+    return 0;
+}
+
+int PieceTable::wordStarts(int from, int to) const {
+    from = qBound(0, from, length());
+    to = qBound(from, to, length());
+
+    int count = 0;
+    bool space = from == 0 || isAsciiSpace(at(from - 1).unicode());
+    const QChar *data;
+    for (int pos = from; pos < to;) {
+        const int n = qMin(to - pos, chunkAt(pos, &data));
+        count += countWordStarts(data, n, space);
+        space = isAsciiSpace(data[n - 1].unicode());
+        pos += n;
+    }
+    return count;
+}
+
+QChar PieceTable::at(int position) const {
+    const QChar *data;
+    return chunkAt(position, &data) > 0 ? *data : QChar();
+}
+
+QString PieceTable::text(int position, int length) const {
+    position = qBound(0, position, this->length());
+    length = qBound(0, length, this->length() - position);
+
+    QString text;
+    text.reserve(length);
+    const QChar *data;
+    while (length > 0) {
+        const int n = qMin(length, chunkAt(position, &data));
+        text.append(data, n);
+        position += n;
+        length -= n;
+    }
+    return text;
+}
+
+QString PieceTable::text() const {
+    return text(0, length());
+}
+
+int PieceTable::lineAt(int position) const {
+    int line = 0;
+    const Node *node = root;
+    while (node) {
+        const int leftLength = node->left ? node->left->totalLength : 0;
+        if (position < leftLength) {
+            node = node->left;
+            continue;
+        }
+        if (node->left)
+            line += node->left->totalNewlines;
+        if (position < leftLength + node->length)
+            return line + newlinesIn(node->buffer, node->start, position - leftLength);
+        line += node->newlines;
+        position -= leftLength + node->length;
+        node = node->right;
+    }
+    return line;
+}
+
+int PieceTable::lineStart(int line) const {
+    if (line <= 0)
+        return 0;
+    if (line >= lineCount())
+        return length();
+
+    // Find the piece holding the line-th '\n', the line starts right after it
+    int position = 0;
+    const Node *node = root;
+    while (node) {
+        const int leftNewlines = node->left ? node->left->totalNewlines : 0;
+        if (line <= leftNewlines) {
+            node = node->left;
+            continue;
+        }
+        line -= leftNewlines;
+        position += node->left ? node->left->totalLength : 0;
+        if (line <= node->newlines) {
+            const QVector<int> &newlines = buffers.at(node->buffer).newlines;
+            const int first = int(std::lower_bound(newlines.begin(), newlines.end(), node->start) - newlines.begin());
+            return position + newlines.at(first + line - 1) - node->start + 1;
+        }
+        line -= node->newlines;
+        position += node->length;
+        node = node->right;
+    }
+    return length();
+}
+
+void PieceTable::collect(const Node *node, Snapshot *snapshot) const {
+    if (!node)
+        return;
+    collect(node->left, snapshot);
+    Snapshot::Piece piece;
+    piece.data = snapshot->buffers.at(node->buffer).constData() + node->start;
+    piece.length = node->length;
+    snapshot->pieces.append(piece);
+    snapshot->starts.append(snapshot->totalLength);
+    snapshot->totalLength += node->length;
+    collect(node->right, snapshot);
+}
+
+PieceTable::Snapshot PieceTable::snapshot() const {
+    // The copies share the buffers' data, appending to a buffer later detaches the table's copy
+    Snapshot snapshot;
+    snapshot.buffers.reserve(buffers.size());
+    for (const Buffer &buffer : buffers)
+        snapshot.buffers.append(buffer.text);
+    collect(root, &snapshot);
+    return snapshot;
+}
+
+int PieceTable::Snapshot::length() const {
+    return totalLength;
+}
+
+int PieceTable::Snapshot::chunkAt(int position, const QChar **data) const {
+    if (position < 0 || position >= totalLength) {
+        *data = nullptr;
+        return 0;
+    }
+    const int index = int(std::upper_bound(starts.begin(), starts.end(), position) - starts.begin()) - 1;
+    const int offset = position - starts.at(index);
+    *data = pieces.at(index).data + offset;
+    return pieces.at(index).length - offset;
+}
+
+QString PieceTable::Snapshot::text(int position, int length) const {
+    position = qBound(0, position, totalLength);
+    length = qBound(0, length, totalLength - position);
+
+    QString text;
+    text.reserve(length);
+    const QChar *data;
+    while (length > 0) {
+        const int n = qMin(length, chunkAt(position, &data));
+        text.append(data, n);
+        position += n;
+        length -= n;
+    }
+    return text;
+}
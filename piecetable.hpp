@@ -0,0 +1,95 @@
+#ifndef PIECETABLE_HPP
+#define PIECETABLE_HPP
+
+#include <QString>
+#include <QVector>
+#include <limits>
+
+/* Copie du texte brut du document sous forme de table de morceaux : un arbre
+   équilibré (treap) de morceaux pointant vers des tampons qui ne font que grandir.
+   Accès aléatoire, extraction et recherche de ligne en O(log n) */
+class PieceTable
+{
+public:
+    /* Copie figée du texte, lisible depuis n'importe quel thread : les tampons sont
+       partagés (copie sur écriture), seule la liste des morceaux est recopiée */
+    class Snapshot
+    {
+    public:
+        int length() const;
+        QString text(int position, int length) const;
+        int chunkAt(int position, const QChar **data) const;
+
+    private:
+        friend class PieceTable;
+        struct Piece
+        {
+            const QChar *data;
+            int length;
+        };
+
+        QVector<QString> buffers;
+        QVector<Piece> pieces;
+        /* Position de début de chaque morceau */
+        QVector<int> starts;
+        int totalLength = 0;
+    };
+
+    /* Longueur maximale du texte : les positions sont des int et setText() reçoit une
+       seule QString, limitée en Qt 5 à un peu moins de 2^30 caractères. Le texte coûte
+       deux octets par caractère, UTF-16 */
+    static const int maxLength = (std::numeric_limits<int>::max() - 4096) / 2;
+
+    PieceTable();
+    ~PieceTable();
+    PieceTable(const PieceTable &) = delete;
+    PieceTable &operator=(const PieceTable &) = delete;
+
+    void setText(const QString &text);
+    void replace(int position, int removed, const QString &added);
+
+    int length() const;
+    int lineCount() const;
+    QChar at(int position) const;
+    QString text(int position, int length) const;
+    QString text() const;
+    /* Morceau contigu qui commence à position, renvoie sa longueur (0 en fin de texte) */
+    int chunkAt(int position, const QChar **data) const;
+    /* Débuts de mots dans [from, to) : caractères hors blancs ASCII qui suivent un blanc
+       ou le début du texte. Sur [0, length()) c'est le nombre de mots */
+    int wordStarts(int from, int to) const;
+    /* Instantané pour les traitements en arrière-plan, en O(nombre de morceaux) */
+    Snapshot snapshot() const;
+
+    /* Numéro de la ligne (à partir de 0) contenant position */
+    int lineAt(int position) const;
+    /* Position du premier caractère de la ligne */
+    int lineStart(int line) const;
+
+private:
+    struct Buffer
+    {
+        QString text;
+        /* Positions des '\n' dans text, croissantes */
+        QVector<int> newlines;
+    };
+    struct Node;
+
+    Node *newNode(int buffer, int start, int length);
+    void update(Node *node) const;
+    int newlinesIn(int buffer, int start, int length) const;
+    void split(Node *node, int position, Node *&left, Node *&right);
+    Node *merge(Node *left, Node *right);
+    bool extendLast(Node *node, int buffer, int start, int length, int newlines);
+    void destroy(Node *node);
+    void collect(const Node *node, Snapshot *snapshot) const;
+    void append(const QString &added, int *buffer, int *start);
+
+    QVector<Buffer> buffers;
+    /* Tampon qui reçoit le texte saisi, -1 s'il faut en ouvrir un nouveau */
+    int appendBuffer;
+    Node *root;
+    quint32 seed;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "regexreplace.hpp"
+#include <QCache>
+#include <QMutex>
+#include <QTextCursor>
+#include <QtConcurrent>
+
+// Compiled patterns kept; the oldest goes when a new one comes in
+static const int cachedPatterns = 32;
+
+QRegularExpression cachedRegularExpression(const QString &pattern, QRegularExpression::PatternOptions options)
+{
+    static QMutex mutex;
+    static QCache<QString, QRegularExpression> cache(cachedPatterns);
+
+    const QString key = QString::number(int(options)) + QLatin1Char(':') + pattern;
+    QMutexLocker locker(&mutex);
+    if (QRegularExpression *regex = cache.object(key))
+        return *regex;
+
+    QRegularExpression *regex = new QRegularExpression(pattern, options);
+    // Compiles and JIT-compiles now rather than on the first match of every copy
+    regex->optimize();
+    const QRegularExpression compiled = *regex;
+    cache.insert(key, regex);
+    return compiled;
+}
+
+QString expandReplacement(const QString &replacement, const QRegularExpressionMatch &match)
+{
+    QString expanded;
+    expanded.reserve(replacement.size());
+    for (int i = 0; i < replacement.size(); ++i) {
+        const QChar c = replacement.at(i);
+        if (c != QLatin1Char('\\') || i + 1 == replacement.size()) {
+            expanded += c;
+            continue;
+        }
+        const QChar next = replacement.at(++i);
+        if (next.isDigit())
+            expanded += match.captured(next.digitValue());
+        else if (next == QLatin1Char('n'))
+            expanded += QLatin1Char('\n');
+        else if (next == QLatin1Char('t'))
+            expanded += QLatin1Char('\t');
+        else
+            expanded += next;
+    }
+    return expanded;
+}
+
+ReplaceScan findReplacements(const PieceTable::Snapshot &text, const QRegularExpression &regex,
+                             const QString &replacement, bool expand, int limit, const SearchCancel &cancel)
+{
+    ReplaceScan scan;
+    QRegularExpressionMatchIterator it = regex.globalMatch(text.text(0, text.length()));
+    while (it.hasNext()) {
+        if (cancel->loadAcquire()) {
+            scan.cancelled = true;
+            return scan;
+        }
+        if (limit >= 0 && scan.matches.size() >= limit)
+            break;
+        const QRegularExpressionMatch match = it.next();
+        scan.matches.append({match.capturedStart(), match.capturedLength(),
+                             expand ? expandReplacement(replacement, match) : replacement});
+    }
+    return scan;
+}
+
+QFuture<ReplaceScan> startReplaceScan(const PieceTable &buffer, const QRegularExpression &regex,
+                                      const QString &replacement, bool expand, int limit, const SearchCancel &cancel)
+{
+    const PieceTable::Snapshot text = buffer.snapshot();
+    return QtConcurrent::run([=]() {
+        return findReplacements(text, regex, replacement, expand, limit, cancel);
+    });
+}
+
+QFuture<ReplaceScan> startReplaceScan(const PieceTable &buffer, const SearchQuery &query,
+                                      const QString &replacement, int limit, const SearchCancel &cancel)
+{
+    const PieceTable::Snapshot text = buffer.snapshot();
+    return QtConcurrent::run([=]() {
+        const SearchResult result = findAll(text, query, cancel, {{0, text.length()}}, limit);
+        ReplaceScan scan;
+        scan.cancelled = result.cancelled;
+        scan.matches.reserve(result.matches.size());
+        for (const SearchMatch &match : result.matches)
+            scan.matches.append({match.start, match.length, replacement});
+        return scan;
+    });
+}
+
+void replaceInDocument(QTextCursor cursor, const QVector<ReplaceMatch> &matches)
+{
+    cursor.beginEditBlock();
+    for (int i = matches.size() - 1; i >= 0; --i) {
+        cursor.setPosition(matches.at(i).start);
+        cursor.setPosition(matches.at(i).start + matches.at(i).length, QTextCursor::KeepAnchor);
+        cursor.insertText(matches.at(i).replacement);
+    }
+    cursor.endEditBlock();
+}
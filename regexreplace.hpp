@@ -0,0 +1,51 @@
+#ifndef REGEXREPLACE_HPP
+#define REGEXREPLACE_HPP
+
+#include <QString>
+#include <QVector>
+#include <QFuture>
+#include <QRegularExpression>
+#include "piecetable.hpp"
+#include "textsearch.hpp"
+
+class QTextCursor;
+
+/* Expression compilée (et optimisée) gardée en cache : répéter une recherche ne
+   recompile pas le motif. Partagée entre threads, les copies ne coûtent rien */
+QRegularExpression cachedRegularExpression(const QString &pattern, QRegularExpression::PatternOptions options);
+
+/* Texte de remplacement avec \0 à \9 remplacés par les groupes capturés,
+   \\ pour une barre oblique, \n et \t */
+QString expandReplacement(const QString &replacement, const QRegularExpressionMatch &match);
+
+struct ReplaceMatch
+{
+    int start;
+    int length;
+    QString replacement;
+};
+
+struct ReplaceScan
+{
+    /* Triées, sans chevauchement */
+    QVector<ReplaceMatch> matches;
+    bool cancelled = false;
+};
+
+/* Occurrences de regex et leur remplacement, au plus limit (-1 : toutes). Le jeton est
+   consulté entre deux occurrences ; une seule occurrence reste bornée par la limite
+   de retour arrière de PCRE */
+ReplaceScan findReplacements(const PieceTable::Snapshot &text, const QRegularExpression &regex,
+                             const QString &replacement, bool expand, int limit, const SearchCancel &cancel);
+QFuture<ReplaceScan> startReplaceScan(const PieceTable &buffer, const QRegularExpression &regex,
+                                      const QString &replacement, bool expand, int limit, const SearchCancel &cancel);
+/* Motif littéral : même recherche que la barre de recherche, remplacement tel quel */
+QFuture<ReplaceScan> startReplaceScan(const PieceTable &buffer, const SearchQuery &query,
+                                      const QString &replacement, int limit, const SearchCancel &cancel);
+
+/* Remplacements faits dans le document de cursor, de la dernière occurrence à la première
+   pour que les positions des précédentes restent justes. Un seul bloc d'édition : une
+   étape d'annulation, une mise en page et un seul contentsChange */
+void replaceInDocument(QTextCursor cursor, const QVector<ReplaceMatch> &matches);
+
+#endif
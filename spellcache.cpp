@@ -0,0 +1,98 @@
+#include "spellcache.hpp"
+#include "hunspell/hunspell.hxx"
+
+SpellCache::SpellCache(Hunspell *checker, int maxWords)
+        : checker(checker), entries(maxWords), generation(0) {
+}
+
+bool SpellCache::isCorrect(const QString &word) {
+    quint64 asked;
+    {
+        QMutexLocker locker(&mutex);
+        ++counters.lookups;
+        if (const Entry *entry = entries.object(word)) {
+            ++counters.hits;
+            return entry->correct;
+        }
+        asked = generation;
+    }
+
+    bool correct;
+    {
+        QMutexLocker locker(&checkerMutex);
+        correct = checker->spell(word.toStdString());
+    }
+
+    QMutexLocker locker(&mutex);
+    if (asked == generation && !entries.contains(word))
+        entries.insert(word, new Entry{correct, false, QStringList()});
+    return correct;
+}
+
+bool SpellCache::lookup(const QString &word, bool *correct) {
+    QMutexLocker locker(&mutex);
+    const Entry *entry = entries.object(word);
+    if (!entry)
+        return false;
+    ++counters.lookups;
+    ++counters.hits;
+    *correct = entry->correct;
+    return true;
+}
+
+QStringList SpellCache::suggestions(const QString &word) {
+    quint64 asked;
+    {
+        QMutexLocker locker(&mutex);
+        ++counters.suggestionLookups;
+        const Entry *entry = entries.object(word);
+        if (entry && (entry->correct || entry->suggested)) {
+            ++counters.suggestionHits;
+            return entry->suggestions;
+        }
+        asked = generation;
+    }
+
+    // suggest() takes milliseconds, the cache stays available meanwhile
+    bool correct;
+    QStringList suggestions;
+    {
+        QMutexLocker locker(&checkerMutex);
+        correct = checker->spell(word.toStdString());
+        if (!correct) {
+            for (const std::string &suggestion : checker->suggest(word.toStdString()))
+                suggestions.append(QString::fromStdString(suggestion));
+        }
+    }
+
+    QMutexLocker locker(&mutex);
+    if (asked == generation)
+        entries.insert(word, new Entry{correct, true, suggestions});
+    return suggestions;
+}
+
+void SpellCache::addWord(const QString &word) {
+    {
+        QMutexLocker locker(&checkerMutex);
+        checker->add(word.toStdString());
+    }
+    clear();
+}
+
+void SpellCache::clear() {
+    QMutexLocker locker(&mutex);
+    entries.clear();
+    ++generation;
+}
+
+double SpellCache::Statistics::hitRate() const {
+    const quint64 total = lookups + suggestionLookups;
+    return total ? double(hits + suggestionHits) / double(total) : 0.0;
+}
+
+SpellCache::Statistics SpellCache::statistics() const {
+    QMutexLocker locker(&mutex);
+    Statistics statistics = counters;
+    statistics.words = entries.size();
+    return statistics;
+}
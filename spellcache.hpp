@@ -0,0 +1,62 @@
+#ifndef SPELLCACHE_HPP
+#define SPELLCACHE_HPP
+
+#include <QString>
+#include <QStringList>
+#include <QCache>
+#include <QMutex>
+
+class Hunspell;
+
+/* Réponses de Hunspell gardées par mot : correct ou non, et suggestions une fois
+   demandées. Borné, les mots servis le moins récemment sortent en premier. Utilisable
+   depuis plusieurs threads ; Hunspell n'est appelé que par un thread à la fois */
+class SpellCache
+{
+public:
+    explicit SpellCache(Hunspell *checker, int maxWords = 50000);
+
+    bool isCorrect(const QString &word);
+    /* Réponse déjà en cache seulement, sans jamais attendre Hunspell : faux si le mot
+       n'y est pas. Un échec n'est pas compté, isCorrect le comptera */
+    bool lookup(const QString &word, bool *correct);
+    /* Vide si le mot est correct */
+    QStringList suggestions(const QString &word);
+    /* Mot ajouté au dictionnaire pour la session, le cache est vidé */
+    void addWord(const QString &word);
+    /* À appeler quand le dictionnaire change */
+    void clear();
+
+    struct Statistics
+    {
+        quint64 lookups = 0;
+        quint64 hits = 0;
+        quint64 suggestionLookups = 0;
+        quint64 suggestionHits = 0;
+        int words = 0;
+
+        /* Part des deux sortes de demandes servies par le cache */
+        double hitRate() const;
+    };
+    Statistics statistics() const;
+
+private:
+    struct Entry
+    {
+        bool correct;
+        bool suggested;
+        QStringList suggestions;
+    };
+
+    Hunspell *checker;
+    /* Protège le cache, les compteurs et la génération */
+    mutable QMutex mutex;
+    /* Protège Hunspell, tenu pendant ses appels seulement */
+    QMutex checkerMutex;
+    QCache<QString, Entry> entries;
+    Statistics counters;
+    /* Incrémentée à chaque vidage : une réponse calculée avant n'est pas gardée */
+    quint64 generation;
+};
+
+#endif
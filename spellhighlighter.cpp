@@ -0,0 +1,211 @@
+#include "spellhighlighter.hpp"
+#include "spellcache.hpp"
+#include <QTextBlock>
+#include <QTimer>
+#include <QtConcurrent>
+
+// Words sent to the worker at once, and blocks highlighted again per event loop turn
+static const int checkBatch = 2000;
+static const int blocksPerSlice = 200;
+static const int visitsPerSlice = 50000;
+
+namespace {
+// Marks a block that has words still being checked
+class WaitingBlockData : public QTextBlockUserData
+{
+};
+}
+
+SpellHighlighter::SpellHighlighter(SpellCache *cache, QTextDocument *document)
+        : QSyntaxHighlighter(document), cache(cache), enabled(true), dictionaryGeneration(0), checkGeneration(0),
+          recheckBlock(-1), recheckEverything(false), recheckAgain(false) {
+    misspelledFormat.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+    misspelledFormat.setUnderlineColor(Qt::red);
+
+    checkWatcher = new QFutureWatcher<QStringList>(this);
+    connect(checkWatcher, &QFutureWatcher<QStringList>::finished, this, &SpellHighlighter::checkFinished);
+
+    recheckTimer = new QTimer(this);
+    recheckTimer->setSingleShot(true);
+    recheckTimer->setInterval(0);
+    connect(recheckTimer, &QTimer::timeout, this, &SpellHighlighter::recheckSlice);
+}
+
+bool SpellHighlighter::isEnabled() const {
+    return enabled;
+}
+
+void SpellHighlighter::setEnabled(bool enabled) {
+    if (enabled == this->enabled)
+        return;
+    this->enabled = enabled;
+    startRecheck(true);
+}
+
+void SpellHighlighter::recheckAll() {
+    startRecheck(true);
+}
+
+void SpellHighlighter::dictionaryChanged() {
+    ++dictionaryGeneration;
+    answered.clear();
+    unchecked.clear();
+    startRecheck(true);
+}
+
+bool SpellHighlighter::isMisspelled(const QString &word) {
+    return !cache->isCorrect(word);
+}
+
+bool SpellHighlighter::lookup(const QString &word, bool *correct) const {
+    const auto it = answered.constFind(word);
+    if (it != answered.constEnd()) {
+        *correct = it.value();
+        return true;
+    }
+    return cache->lookup(word, correct);
+}
+
+static inline bool isApostrophe(QChar c)
+{
+    return c == QLatin1Char('\'') || c == QChar(0x2019);
+}
+
+static inline bool gluesWord(QChar c)
+{
+    return c.isDigit() || c == QLatin1Char('_');
+}
+
+int SpellHighlighter::nextWord(const QString &text, int from, int *start) {
+    const int size = text.size();
+    int i = from;
+    while (i < size) {
+        while (i < size && !text.at(i).isLetter())
+            ++i;
+        if (i == size)
+            break;
+        // Letters, and apostrophes between letters as in "don't"
+        const int begin = i;
+        while (i < size && (text.at(i).isLetter()
+                            || (isApostrophe(text.at(i)) && i + 1 < size && text.at(i + 1).isLetter())))
+            ++i;
+        if ((begin == 0 || !gluesWord(text.at(begin - 1))) && (i == size || !gluesWord(text.at(i)))) {
+            *start = begin;
+            return i - begin;
+        }
+        while (i < size && (text.at(i).isLetterOrNumber() || text.at(i) == QLatin1Char('_')))
+            ++i;
+    }
+    return 0;
+}
+
+void SpellHighlighter::highlightBlock(const QString &text) {
+    bool waiting = false;
+    if (enabled) {
+        int start = 0;
+        int length;
+        for (int from = 0; (length = nextWord(text, from, &start)) > 0; from = start + length) {
+            const QString word = text.mid(start, length);
+            bool correct;
+            if (!lookup(word, &correct)) {
+                if (!checking.contains(word))
+                    unchecked.insert(word);
+                waiting = true;
+            } else if (!correct) {
+                setFormat(start, length, misspelledFormat);
+            }
+        }
+    }
+
+    if (waiting != (currentBlockUserData() != nullptr))
+        setCurrentBlockUserData(waiting ? new WaitingBlockData : nullptr);
+    if (!unchecked.isEmpty())
+        startCheck();
+}
+
+void SpellHighlighter::startCheck() {
+    if (checkWatcher->isRunning() || unchecked.isEmpty())
+        return;
+
+    QStringList words;
+    words.reserve(qMin(unchecked.size(), checkBatch));
+    for (auto it = unchecked.begin(); it != unchecked.end() && words.size() < checkBatch;) {
+        words.append(*it);
+        checking.insert(*it);
+        it = unchecked.erase(it);
+    }
+    SpellCache *const cache = this->cache;
+    checkGeneration = dictionaryGeneration;
+    checkWatcher->setFuture(QtConcurrent::run([cache, words]() {
+        QStringList misspelled;
+        for (const QString &word : words) {
+            if (!cache->isCorrect(word))
+                misspelled.append(word);
+        }
+        return misspelled;
+    }));
+}
+
+void SpellHighlighter::checkFinished() {
+    if (checkGeneration == dictionaryGeneration) {
+        const QStringList misspelled = checkWatcher->result();
+        for (const QString &word : checking)
+            answered.insert(word, true);
+        for (const QString &word : misspelled)
+            answered.insert(word, false);
+    } else {
+        // Checked against the previous dictionary
+        unchecked += checking;
+    }
+    checking.clear();
+
+    // The waiting blocks are read again once every batch is back
+    startCheck();
+    if (!checkWatcher->isRunning())
+        startRecheck(false);
+}
+
+void SpellHighlighter::startRecheck(bool all) {
+    if (recheckBlock < 0 || all) {
+        recheckBlock = 0;
+        recheckEverything = recheckEverything || all;
+    } else {
+        recheckAgain = true;
+    }
+    recheckTimer->start();
+}
+
+void SpellHighlighter::recheckSlice() {
+    if (!document()) {
+        recheckBlock = -1;
+        return;
+    }
+    // Edits during the pass shift the block numbers: a block may be read twice, the pass
+    // that a later batch triggers catches one that was skipped
+    QTextBlock block = document()->findBlockByNumber(recheckBlock);
+    int highlighted = 0;
+    for (int visited = 0; block.isValid() && visited < visitsPerSlice && highlighted < blocksPerSlice; ++visited) {
+        if (recheckEverything || block.userData()) {
+            rehighlightBlock(block);
+            ++highlighted;
+        }
+        block = block.next();
+        ++recheckBlock;
+    }
+    if (block.isValid()) {
+        recheckTimer->start();
+        return;
+    }
+
+    recheckEverything = false;
+    if (recheckAgain) {
+        recheckAgain = false;
+        recheckBlock = 0;
+        recheckTimer->start();
+    } else {
+        recheckBlock = -1;
+        // Every block waiting for them has been read again, the cache answers from now on
+        if (!checkWatcher->isRunning() && unchecked.isEmpty())
+            answered.clear();
+    }
+}
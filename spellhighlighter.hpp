@@ -0,0 +1,74 @@
+#ifndef SPELLHIGHLIGHTER_HPP
+#define SPELLHIGHLIGHTER_HPP
+
+#include <QSyntaxHighlighter>
+#include <QTextCharFormat>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QFutureWatcher>
+
+class QTimer;
+class SpellCache;
+
+/* Orthographe vérifiée au fil de la frappe : seul un bloc modifié est relu, ses mots déjà
+   dans le cache sont soulignés aussitôt, les autres partent par lots vers un thread de
+   travail. Les blocs qui les attendaient sont ensuite relus par tranches, sans bloquer
+   la frappe */
+class SpellHighlighter : public QSyntaxHighlighter
+{
+Q_OBJECT
+
+public:
+    /* Le cache sert toutes les réponses ; il doit survivre au surligneur */
+    SpellHighlighter(SpellCache *cache, QTextDocument *document);
+
+    bool isEnabled() const;
+    /* Mot mal orthographié, vérifié sur place s'il n'est pas encore connu */
+    bool isMisspelled(const QString &word);
+    /* Prochain mot à vérifier de text à partir de from : sa longueur, 0 s'il n'y en a plus.
+       Les mots collés à un chiffre ou à un _ (identifiants, références) sont sautés */
+    static int nextWord(const QString &text, int from, int *start);
+
+public slots:
+    void setEnabled(bool enabled);
+    /* Tous les blocs relus, après un remplissage du document fait signaux bloqués */
+    void recheckAll();
+    /* Mots vérifiés oubliés et tous les blocs relus, le lot en cours est ignoré */
+    void dictionaryChanged();
+
+protected:
+    void highlightBlock(const QString &text) override;
+
+private slots:
+    void checkFinished();
+    void recheckSlice();
+
+private:
+    void startCheck();
+    void startRecheck(bool all);
+
+    bool lookup(const QString &word, bool *correct) const;
+
+    SpellCache *cache;
+    bool enabled;
+    QTextCharFormat misspelledFormat;
+    /* Réponses des lots du tour en cours, vrai si correct : le cache peut les avoir
+       oubliées avant que les blocs qui les attendaient soient relus. Vidé à la fin du tour */
+    QHash<QString, bool> answered;
+    /* Mots en attente du prochain lot, et ceux du lot en cours */
+    QSet<QString> unchecked;
+    QSet<QString> checking;
+    QFutureWatcher<QStringList> *checkWatcher;
+    /* Incrémentée par dictionaryChanged, celle du lot en cours */
+    int dictionaryGeneration;
+    int checkGeneration;
+    /* Relecture par tranches : numéro du bloc suivant (-1 au repos), tous les blocs ou
+       seulement ceux en attente, et nouvelle relecture demandée pendant celle-ci */
+    QTimer *recheckTimer;
+    int recheckBlock;
+    bool recheckEverything;
+    bool recheckAgain;
+};
+
+#endif
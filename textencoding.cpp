@@ -0,0 +1,362 @@
+#include "textencoding.hpp"
+#include "cpufeatures.hpp"
+#include <QTextCodec>
+#include <cstring>
+#ifdef OA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+QTextCodec *TextFileFormat::codec() const {
+    switch (encoding) {
+        case Utf16LE:
+            return QTextCodec::codecForName("UTF-16LE");
+        case Utf16BE:
+            return QTextCodec::codecForName("UTF-16BE");
+        case Latin1:
+            return QTextCodec::codecForName("ISO-8859-1");
+        case Utf8:
+        default:
+            return QTextCodec::codecForName("UTF-8");
+    }
+}
+
+QByteArray TextFileFormat::byteOrderMarkBytes() const {
+    if (!byteOrderMark)
+        return QByteArray();
+    switch (encoding) {
+        case Utf8:
+            return QByteArray("\xef\xbb\xbf", 3);
+        case Utf16LE:
+            return QByteArray("\xff\xfe", 2);
+        case Utf16BE:
+            return QByteArray("\xfe\xff", 2);
+        default:
+            return QByteArray();
+    }
+}
+
+int detectEncoding(const char *data, qint64 length, TextFileFormat *format)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    format->byteOrderMark = true;
+    if (length >= 3 && bytes[0] == 0xef && bytes[1] == 0xbb && bytes[2] == 0xbf) {
+        format->encoding = TextFileFormat::Utf8;
+        return 3;
+    }
+    if (length >= 2 && bytes[0] == 0xff && bytes[1] == 0xfe) {
+        format->encoding = TextFileFormat::Utf16LE;
+        return 2;
+    }
+    if (length >= 2 && bytes[0] == 0xfe && bytes[1] == 0xff) {
+        format->encoding = TextFileFormat::Utf16BE;
+        return 2;
+    }
+    format->byteOrderMark = false;
+    format->encoding = isValidUtf8(data, length) ? TextFileFormat::Utf8 : TextFileFormat::Latin1;
+    return 0;
+}
+
+qint64 completeUtf8Sequences(const char *data, qint64 length)
+{
+    for (qint64 back = 1; back <= qMin<qint64>(4, length); ++back) {
+        const uchar c = uchar(data[length - back]);
+        if ((c & 0xc0) != 0x80)
+            return c >= 0xc0 ? length - back : length;
+    }
+    return length;
+}
+
+/* Checks the sequence starting at p and returns the position after it, or null.
+   Overlong forms, surrogates and code points above U+10FFFF are rejected. */
+static const uchar *nextCharacter(const uchar *p, const uchar *end)
+{
+    const uchar c = *p;
+    if (c < 0x80)
+        return p + 1;
+
+    int continuation;
+    uchar low = 0x80, high = 0xbf;
+    if (c >= 0xc2 && c <= 0xdf) {
+        continuation = 1;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        continuation = 2;
+        if (c == 0xe0)
+            low = 0xa0;
+        else if (c == 0xed)
+            high = 0x9f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        continuation = 3;
+        if (c == 0xf0)
+            low = 0x90;
+        else if (c == 0xf4)
+            high = 0x8f;
+    } else {
+        return nullptr;
+    }
+    if (end - p <= continuation || p[1] < low || p[1] > high)
+        return nullptr;
+    for (int i = 2; i <= continuation; ++i) {
+        if ((p[i] & 0xc0) != 0x80)
+            return nullptr;
+    }
+    return p + continuation + 1;
+}
+
+static bool isValidUtf8Scalar(const uchar *p, const uchar *end)
+{
+    while (p && p < end)
+        p = nextCharacter(p, end);
+    return p != nullptr;
+}
+
+#ifdef OA_X86_SIMD
+
+static bool isValidUtf8Sse2(const uchar *p, const uchar *end)
+{
+    // 16 byte blocks of ASCII are skipped, the characters of other blocks are checked one by one
+    while (end - p >= 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        const int mask = _mm_movemask_epi8(block);
+        if (mask == 0) {
+            p += 16;
+            continue;
+        }
+        const uchar *const blockEnd = p + 16;
+        p += qCountTrailingZeroBits(uint(mask));
+        while (p && p < blockEnd)
+            p = nextCharacter(p, end);
+        if (!p)
+            return false;
+    }
+    return isValidUtf8Scalar(p, end);
+}
+
+/* Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+   Each byte is classified from the high nibble of its predecessor, the low nibble
+   of its predecessor and its own high nibble; the three lookups are ANDed and any
+   bit left over names an error, except for the third and fourth bytes of a sequence
+   which must be continuations and come out as exactly 0x80. */
+enum : uchar {
+    TooShort = 1 << 0,
+    TooLong = 1 << 1,
+    Overlong3 = 1 << 2,
+    TooLarge = 1 << 3,
+    Surrogate = 1 << 4,
+    Overlong2 = 1 << 5,
+    TooLarge1000 = 1 << 6,
+    Overlong4 = 1 << 6,
+    TwoConts = 1 << 7,
+    Carry = TooShort | TooLong | TwoConts
+};
+
+OA_TARGET_AVX2 static inline __m256i lookup16(__m256i nibbles, const uchar (&table)[16])
+{
+    const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i *>(table));
+    return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(half), nibbles);
+}
+
+/* The bytes of input shifted right by n, the gap filled from the end of previous */
+template <int n>
+OA_TARGET_AVX2 static inline __m256i previousBytes(__m256i input, __m256i previous)
+{
+    return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - n);
+}
+
+OA_TARGET_AVX2 static bool isValidUtf8Avx2(const uchar *p, const uchar *end)
+{
+    const uchar *const start = p;
+    static const uchar byte1High[16] = {
+        TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+        TwoConts, TwoConts, TwoConts, TwoConts,
+        TooShort | Overlong2,
+        TooShort,
+        TooShort | Overlong3 | Surrogate,
+        TooShort | TooLarge | TooLarge1000 | Overlong4
+    };
+    static const uchar byte1Low[16] = {
+        Carry | Overlong3 | Overlong2 | Overlong4,
+        Carry | Overlong2,
+        Carry,
+        Carry,
+        Carry | TooLarge,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000 | Surrogate,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000
+    };
+    static const uchar byte2High[16] = {
+        TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+        TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4,
+        TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,
+        TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+        TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+        TooShort, TooShort, TooShort, TooShort
+    };
+
+    const __m256i lowNibble = _mm256_set1_epi8(0x0f);
+    // A lead byte in the last three positions needs bytes from the next block
+    const __m256i incompleteMax = _mm256_setr_epi8(
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+            char(0xf0 - 1), char(0xe0 - 1), char(0xc0 - 1));
+
+    __m256i error = _mm256_setzero_si256();
+    __m256i previous = _mm256_setzero_si256();
+    __m256i previousIncomplete = _mm256_setzero_si256();
+    for (; end - p >= 32; p += 32) {
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        if (_mm256_movemask_epi8(input) == 0) {
+            // Pure ASCII, only a sequence left open by the previous block is wrong
+            error = _mm256_or_si256(error, previousIncomplete);
+            previous = input;
+            previousIncomplete = _mm256_setzero_si256();
+            continue;
+        }
+
+        const __m256i prev1 = previousBytes<1>(input, previous);
+        const __m256i special = _mm256_and_si256(
+                _mm256_and_si256(lookup16(_mm256_and_si256(_mm256_srli_epi16(prev1, 4), lowNibble), byte1High),
+                                 lookup16(_mm256_and_si256(prev1, lowNibble), byte1Low)),
+                lookup16(_mm256_and_si256(_mm256_srli_epi16(input, 4), lowNibble), byte2High));
+
+        const __m256i prev2 = previousBytes<2>(input, previous);
+        const __m256i prev3 = previousBytes<3>(input, previous);
+        const __m256i thirdByte = _mm256_subs_epu8(prev2, _mm256_set1_epi8(char(0xe0 - 0x80)));
+        const __m256i fourthByte = _mm256_subs_epu8(prev3, _mm256_set1_epi8(char(0xf0 - 0x80)));
+        const __m256i must23 = _mm256_and_si256(_mm256_or_si256(thirdByte, fourthByte), _mm256_set1_epi8(char(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23, special));
+
+        previous = input;
+        previousIncomplete = _mm256_subs_epu8(input, incompleteMax);
+    }
+    if (!_mm256_testz_si256(error, error))
+        return false;
+
+    // The scalar tail restarts at the lead byte of a sequence the last block left open
+    const uchar *tail = p;
+    for (int back = 1; back <= 3 && p - back >= start; ++back) {
+        const uchar c = p[-back];
+        if ((c & 0xc0) != 0x80) {
+            if (c >= 0xc0)
+                tail = p - back;
+            break;
+        }
+    }
+    return isValidUtf8Scalar(tail, end);
+}
+
+#endif
+
+bool isValidUtf8(const char *data, qint64 length)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data);
+    const uchar *end = p + length;
+#ifdef OA_X86_SIMD
+    if (cpuHasAvx2())
+        return isValidUtf8Avx2(p, end);
+    return isValidUtf8Sse2(p, end);
+#else
+    return isValidUtf8Scalar(p, end);
+#endif
+}
+
+/* Index of the first '\r' in [from, length), or length */
+static int findCarriageReturn(const ushort *data, int from, int length)
+{
+    int i = from;
+#ifdef OA_X86_SIMD
+    const __m128i cr = _mm_set1_epi16('\r');
+    for (; length - i >= 8; i += 8) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(chars, cr));
+        if (mask)
+            return i + qCountTrailingZeroBits(uint(mask)) / 2;
+    }
+#endif
+    for (; i < length; ++i) {
+        if (data[i] == '\r')
+            return i;
+    }
+    return length;
+}
+
+void LineEndingNormalizer::found(TextFileFormat::LineEnding ending) {
+    if (!known) {
+        first = ending;
+        known = true;
+    }
+}
+
+void LineEndingNormalizer::normalize(QString &text) {
+    // A decoder holding back a partial character hands out empty text, the '\r' keeps waiting
+    if (text.isEmpty())
+        return;
+    if (pendingCr) {
+        pendingCr = false;
+        if (text.startsWith(QLatin1Char('\n'))) {
+            found(TextFileFormat::CRLF);
+        } else {
+            text.prepend(QLatin1Char('\n'));
+            found(TextFileFormat::CR);
+        }
+    }
+
+    ushort *data = reinterpret_cast<ushort *>(text.data());
+    const int length = text.size();
+    if (!known) {
+        for (int i = 0; i < length; ++i) {
+            if (data[i] == '\n') {
+                found(TextFileFormat::LF);
+                break;
+            }
+            if (data[i] == '\r') {
+                if (i + 1 < length)
+                    found(data[i + 1] == '\n' ? TextFileFormat::CRLF : TextFileFormat::CR);
+                break;
+            }
+        }
+    }
+
+    // Text without '\r' is left alone; otherwise the runs between them move down
+    int i = findCarriageReturn(data, 0, length);
+    if (i == length)
+        return;
+    int out = i;
+    while (i < length) {
+        if (i + 1 == length) {
+            pendingCr = true;
+            break;
+        }
+        if (data[i + 1] != '\n')
+            data[out++] = '\n';
+        ++i;
+        const int next = findCarriageReturn(data, i, length);
+        std::memmove(data + out, data + i, size_t(next - i) * sizeof(ushort));
+        out += next - i;
+        i = next;
+    }
+    text.truncate(out);
+}
+
+void LineEndingNormalizer::finish(QString &text) {
+    if (pendingCr) {
+        pendingCr = false;
+        text += QLatin1Char('\n');
+        found(TextFileFormat::CR);
+    }
+}
+
+bool LineEndingNormalizer::hasLineEnding() const {
+    return known;
+}
+
+TextFileFormat::LineEnding LineEndingNormalizer::lineEnding() const {
+    return first;
+}
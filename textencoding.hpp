@@ -0,0 +1,56 @@
+#ifndef TEXTENCODING_HPP
+#define TEXTENCODING_HPP
+
+#include <QString>
+#include <QByteArray>
+
+class QTextCodec;
+
+/* Encodage et fins de ligne d'origine d'un fichier texte, rendus tels quels à l'enregistrement */
+struct TextFileFormat
+{
+    enum Encoding { Utf8, Utf16LE, Utf16BE, Latin1 };
+    enum LineEnding { LF, CRLF, CR };
+
+    Encoding encoding = Utf8;
+    bool byteOrderMark = false;
+    /* Nouveaux fichiers, et fichiers sans aucune fin de ligne : celle de la plateforme */
+#ifdef Q_OS_WIN
+    LineEnding lineEnding = CRLF;
+#else
+    LineEnding lineEnding = LF;
+#endif
+
+    QTextCodec *codec() const;
+    QByteArray byteOrderMarkBytes() const;
+};
+
+/* BOM UTF-8 ou UTF-16 en tête, sinon UTF-8 si tout le contenu est valide, sinon Latin-1.
+   Renvoie la longueur de la BOM à sauter */
+int detectEncoding(const char *data, qint64 length, TextFileFormat *format);
+/* Longueur de data sans la séquence UTF-8 coupée par sa fin, pour qu'un morceau lu
+   en plusieurs fois ne passe pas pour invalide */
+qint64 completeUtf8Sequences(const char *data, qint64 length);
+/* Validation UTF-8 complète, vectorisée (AVX2 si disponible, sinon SSE2 sur l'ASCII) */
+bool isValidUtf8(const char *data, qint64 length);
+
+/* Fins de ligne normalisées morceau par morceau : CRLF et CR deviennent LF, et la
+   première fin de ligne rencontrée est retenue pour l'enregistrement */
+class LineEndingNormalizer
+{
+public:
+    void normalize(QString &text);
+    /* Fin du fichier : un '\r' resté en attente du morceau suivant est un CR seul */
+    void finish(QString &text);
+    bool hasLineEnding() const;
+    TextFileFormat::LineEnding lineEnding() const;
+
+private:
+    void found(TextFileFormat::LineEnding ending);
+
+    bool pendingCr = false;
+    bool known = false;
+    TextFileFormat::LineEnding first = TextFileFormat::LF;
+};
+
+#endif
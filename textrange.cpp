@@ -0,0 +1,51 @@
+#include "textrange.hpp"
+#include <QTextDocument>
+#include <QTextBlock>
+
+QString plainTextRange(const QTextDocument *document, int position, int length)
+{
+    // The final paragraph separator is not part of the plain text
+    const int end = qMin(position + length, document->characterCount() - 1);
+    if (position < 0 || end <= position)
+        return QString();
+
+    QString text;
+    text.reserve(end - position);
+    for (QTextBlock block = document->findBlock(position); block.isValid() && block.position() < end; block = block.next()) {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            const int from = qMax(position, fragment.position());
+            const int to = qMin(end, fragment.position() + fragment.length());
+            if (from < to)
+                text += fragment.text().midRef(from - fragment.position(), to - from);
+        }
+        // Paragraph separators and frame markers all read as '\n'
+        const int separator = block.position() + block.length() - 1;
+        if (separator >= position && separator < end)
+            text += QLatin1Char('\n');
+    }
+
+    // Same substitutions as QTextDocument::toPlainText()
+    QChar *uc = text.data();
+    QChar *const e = uc + text.size();
+    for (; uc != e; ++uc) {
+        switch (uc->unicode()) {
+            case QChar::LineSeparator:
+                *uc = QLatin1Char('\n');
+                break;
+            case QChar::Nbsp:
+                *uc = QLatin1Char(' ');
+                break;
+            default:
+                break;
+        }
+    }
+    return text;
+}
+
+void clampContentsChange(const QTextDocument *document, int position, int *charsRemoved, int *charsAdded)
+{
+    const int overflow = qMax(0, position + *charsAdded - (document->characterCount() - 1));
+    *charsAdded -= overflow;
+    *charsRemoved = qMax(0, *charsRemoved - overflow);
+}
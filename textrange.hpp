@@ -0,0 +1,16 @@
+#ifndef TEXTRANGE_HPP
+#define TEXTRANGE_HPP
+
+#include <QString>
+
+class QTextDocument;
+
+/* Texte brut de [position, position + length) tel que toPlainText() le rendrait,
+   sans aplatir tout le document */
+QString plainTextRange(const QTextDocument *document, int position, int length);
+
+/* contentsChange compte parfois le séparateur de paragraphe final, des deux côtés ;
+   ramener les deux longueurs au texte brut */
+void clampContentsChange(const QTextDocument *document, int position, int *charsRemoved, int *charsAdded);
+
+#endif
@@ -0,0 +1,145 @@
+#include "textsearch.hpp"
+#include "trigramindex.hpp"
+#include "literalsearch.hpp"
+#include <QtConcurrent>
+#include <algorithm>
+
+// Characters searched between two looks at the cancel token
+static const int searchWindow = 1024 * 1024;
+
+bool SearchQuery::operator==(const SearchQuery &other) const
+{
+    return pattern == other.pattern && caseSensitivity == other.caseSensitivity && wholeWords == other.wholeWords;
+}
+
+bool SearchQuery::operator!=(const SearchQuery &other) const
+{
+    return !(*this == other);
+}
+
+bool isWordCharacter(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_');
+}
+
+/* Text is a snapshot for the searches in the background, or the buffer itself for the
+   small rescans of updateMatches on the GUI thread; only text(position, length) windows
+   are read from it */
+template <typename Text>
+static SearchResult findIn(const Text &text, const SearchQuery &query, const SearchCancel &cancel,
+                           const QVector<SearchRange> &ranges, int limit)
+{
+    SearchResult result;
+    result.query = query;
+    const int patternLength = query.pattern.size();
+    if (patternLength == 0)
+        return result;
+    const LiteralMatcher matcher(query.pattern, query.caseSensitivity);
+
+    // Each window reaches past its end by the pattern length, and by one character on
+    // each side for the whole word test; a match belongs to the window it starts in
+    int nextFree = 0;
+    for (const SearchRange &range : ranges) {
+        for (int pos = qMax(range.start, nextFree); pos < range.end; pos += searchWindow) {
+            if (cancel->loadAcquire()) {
+                result.cancelled = true;
+                return result;
+            }
+            const int from = qMax(0, pos - 1);
+            const int windowEnd = qMin(pos + searchWindow, range.end);
+            const QString window = text.text(from, windowEnd + patternLength + 1 - from);
+
+            int i = matcher.indexIn(window, pos - from);
+            while (i >= 0 && from + i < windowEnd) {
+                if (query.wholeWords) {
+                    const bool before = from + i > 0 && isWordCharacter(window.at(i - 1));
+                    const bool after = i + patternLength < window.size()
+                                       && isWordCharacter(window.at(i + patternLength));
+                    if (before || after) {
+                        i = matcher.indexIn(window, i + 1);
+                        continue;
+                    }
+                }
+                result.matches.append({from + i, patternLength});
+                if (result.matches.size() == limit)
+                    return result;
+                nextFree = from + i + patternLength;
+                i = matcher.indexIn(window, i + patternLength);
+            }
+            // The next window starts after a match that crossed into it
+            pos = qMax(pos, nextFree - searchWindow);
+        }
+    }
+    return result;
+}
+
+SearchResult findAll(const PieceTable::Snapshot &text, const SearchQuery &query, const SearchCancel &cancel,
+                     const QVector<SearchRange> &ranges, int limit)
+{
+    return findIn(text, query, cancel, ranges, limit);
+}
+
+QFuture<SearchResult> startSearch(const PieceTable &buffer, const SearchQuery &query, const SearchCancel &cancel,
+                                  const TrigramIndex *index)
+{
+    // Narrowing runs here: it only reads the block signatures, a few milliseconds at most
+    QVector<SearchRange> ranges;
+    if (!index || !index->candidates(query.pattern, &ranges))
+        ranges = {{0, buffer.length()}};
+    return QtConcurrent::run(findAll, buffer.snapshot(), query, cancel, ranges, -1);
+}
+
+void updateMatches(SearchResult *result, const PieceTable &buffer, int position, int removed, int added)
+{
+    QVector<SearchMatch> &matches = result->matches;
+    const int patternLength = result->query.pattern.size();
+    if (patternLength == 0)
+        return;
+    const auto startsBefore = [](const SearchMatch &match, int start) { return match.start < start; };
+
+    // Matches from first to last had their text or a neighbouring character replaced,
+    // the ones after last only move
+    const int first = int(std::lower_bound(matches.begin(), matches.end(), position - patternLength - 1, startsBefore)
+                          - matches.begin());
+    const int last = int(std::lower_bound(matches.begin() + first, matches.end(), position + removed + 2, startsBefore)
+                         - matches.begin());
+    const int delta = added - removed;
+    for (int i = last; i < matches.size(); ++i)
+        matches[i].start += delta;
+
+    QVector<SearchMatch> patched;
+    patched.reserve(matches.size());
+    std::copy(matches.constBegin(), matches.constBegin() + first, std::back_inserter(patched));
+
+    // Rescan from the edit until the new matches line up with the old ones again: from a
+    // position past the edit that no old match overlaps, both continue with the same
+    // text. A pattern that overlaps itself ("aa" in "aaaa") can shift the following
+    // matches one by one, the scanned span doubles each round. The windows are read from
+    // the buffer directly, a snapshot would copy the list of every piece
+    const SearchCancel cancel = std::make_shared<QAtomicInt>(0);
+    const int dirtyEnd = position + added + 2;
+    int pos = qMax(0, position - patternLength - 1);
+    if (first > 0)
+        pos = qMax(pos, matches.at(first - 1).start + patternLength);
+    int next = last;
+    int span = 4096;
+    for (;;) {
+        while (next < matches.size() && matches.at(next).start < pos)
+            ++next;
+        if (pos >= dirtyEnd + patternLength
+                && (next == last || matches.at(next - 1).start + patternLength <= pos))
+            break;
+        if (pos >= buffer.length()) {
+            next = matches.size();
+            break;
+        }
+        const int end = qMin(buffer.length(), qMax(dirtyEnd + patternLength, pos + span));
+        const SearchResult found = findIn(buffer, result->query, cancel, {{pos, end}}, -1);
+        patched += found.matches;
+        pos = found.matches.isEmpty() ? end : qMax(end, found.matches.last().start + patternLength);
+        if (span < buffer.length())
+            span *= 2;
+    }
+    std::copy(matches.constBegin() + next, matches.constEnd(), std::back_inserter(patched));
+    matches = patched;
+}
@@ -0,0 +1,64 @@
+#ifndef TEXTSEARCH_HPP
+#define TEXTSEARCH_HPP
+
+#include <QString>
+#include <QVector>
+#include <QAtomicInt>
+#include <QFuture>
+#include <memory>
+#include "piecetable.hpp"
+
+/* Recherche dans le texte entier, sur un instantané et hors du thread graphique */
+struct SearchQuery
+{
+    QString pattern;
+    Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive;
+    bool wholeWords = false;
+
+    bool operator==(const SearchQuery &other) const;
+    bool operator!=(const SearchQuery &other) const;
+};
+
+struct SearchMatch
+{
+    int start;
+    int length;
+};
+
+/* Plage de positions où une occurrence peut commencer */
+struct SearchRange
+{
+    int start;
+    int end;
+};
+
+struct SearchResult
+{
+    SearchQuery query;
+    /* Triées, sans chevauchement */
+    QVector<SearchMatch> matches;
+    bool cancelled = false;
+};
+
+/* Jeton d'annulation partagé avec la recherche en cours : le mettre à 1 l'arrête au
+   prochain bloc de texte */
+typedef std::shared_ptr<QAtomicInt> SearchCancel;
+
+class TrigramIndex;
+
+/* Caractère de mot pour l'option « mots entiers » */
+bool isWordCharacter(QChar c);
+
+/* Occurrences qui commencent dans les plages données, triées, les limit premières (-1 : toutes) */
+SearchResult findAll(const PieceTable::Snapshot &text, const SearchQuery &query, const SearchCancel &cancel,
+                     const QVector<SearchRange> &ranges, int limit = -1);
+/* Avec un index prêt, seules les plages candidates sont vérifiées ; sinon tout le texte */
+QFuture<SearchResult> startSearch(const PieceTable &buffer, const SearchQuery &query, const SearchCancel &cancel,
+                                  const TrigramIndex *index = nullptr);
+
+/* Met les occurrences à jour après le remplacement de removed caractères par added à
+   position : les suivantes sont décalées, seules celles autour de la modification sont
+   recherchées à nouveau, sur le thread appelant */
+void updateMatches(SearchResult *result, const PieceTable &buffer, int position, int removed, int added);
+
+#endif
@@ -0,0 +1,228 @@
+#include "trigramindex.hpp"
+#include <QtConcurrent>
+#include <algorithm>
+
+// Characters per block, and bits in each block's signature (a power of two)
+static const int blockChars = 4096;
+static const int signatureBits = 4096;
+static const int signatureWords = signatureBits / 64;
+
+static inline ushort foldCase(ushort c)
+{
+    if (c < 0x80)
+        return c >= 'A' && c <= 'Z' ? ushort(c + 32) : c;
+    return QChar(c).toCaseFolded().unicode();
+}
+
+static inline uint trigramBit(ushort a, ushort b, ushort c)
+{
+    quint32 h = ((quint32(a) << 16) | b) * 0x9e3779b1u ^ quint32(c) * 0x85ebca77u;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    return h >> (32 - 12);
+}
+
+/* Trigrams starting in text[0, length); text holds up to two more characters,
+   those of the next block that the last trigrams reach into */
+static QVector<quint64> signatureOf(const QString &text, int length)
+{
+    QVector<quint64> signature(signatureWords, 0);
+    if (text.size() < 3)
+        return signature;
+    const QChar *data = text.constData();
+    ushort a = foldCase(data[0].unicode());
+    ushort b = foldCase(data[1].unicode());
+    for (int i = 0; i < length && i + 2 < text.size(); ++i) {
+        const ushort c = foldCase(data[i + 2].unicode());
+        const uint bit = trigramBit(a, b, c);
+        signature[bit >> 6] |= quint64(1) << (bit & 63);
+        a = b;
+        b = c;
+    }
+    return signature;
+}
+
+static QVector<TrigramIndex::Block> buildBlocks(const PieceTable::Snapshot &text)
+{
+    QVector<TrigramIndex::Block> blocks;
+    blocks.reserve(text.length() / blockChars + 1);
+    for (int start = 0; start < text.length(); start += blockChars) {
+        TrigramIndex::Block block;
+        block.start = start;
+        block.length = qMin(blockChars, text.length() - start);
+        block.dirty = false;
+        block.signature = signatureOf(text.text(start, block.length + 2), block.length);
+        blocks.append(block);
+    }
+    return blocks;
+}
+
+TrigramIndex::TrigramIndex(const PieceTable *text, QObject *parent)
+        : QObject(parent), text(text), watcher(new QFutureWatcher<QVector<Block>>(this)), building(false), built(false) {
+    connect(watcher, &QFutureWatcher<QVector<Block>>::finished, this, &TrigramIndex::buildFinished);
+}
+
+void TrigramIndex::build() {
+    // A build still running for older text finishes unobserved
+    blocks.clear();
+    pendingEdits.clear();
+    building = true;
+    built = false;
+    watcher->setFuture(QtConcurrent::run(buildBlocks, text->snapshot()));
+}
+
+void TrigramIndex::clear() {
+    watcher->setFuture(QFuture<QVector<Block>>());
+    blocks.clear();
+    pendingEdits.clear();
+    building = false;
+    built = false;
+}
+
+bool TrigramIndex::isReady() const {
+    return built;
+}
+
+void TrigramIndex::buildFinished() {
+    if (!building)
+        return;
+    blocks = watcher->result();
+    building = false;
+    built = true;
+    // The edits made meanwhile only shift and mark blocks, which are then signed from the current text
+    for (const Edit &edit : pendingEdits)
+        adjust(edit);
+    pendingEdits.clear();
+    refreshAll();
+    emit ready();
+}
+
+void TrigramIndex::textChanged(int position, int removed, int added) {
+    const Edit edit = {position, removed, added};
+    if (building) {
+        pendingEdits.append(edit);
+    } else if (built) {
+        const int i = adjust(edit);
+        if (i >= 0)
+            refresh(i);
+    }
+}
+
+/* Last block starting at or before position, the last block past the end */
+int TrigramIndex::blockAt(int position) const {
+    const auto it = std::upper_bound(blocks.constBegin(), blocks.constEnd(), position,
+                                     [](int position, const Block &block) { return position < block.start; });
+    return qMax(0, int(it - blocks.constBegin()) - 1);
+}
+
+/* The blocks holding the edit become a single dirty block, together with the block
+   before when its last trigrams reach into the edited characters. Returns its index,
+   -1 when nothing is left of it */
+int TrigramIndex::adjust(const Edit &edit) {
+    if (blocks.isEmpty()) {
+        if (edit.added <= 0)
+            return -1;
+        blocks.append({0, edit.added, true, QVector<quint64>()});
+        return 0;
+    }
+
+    int first = blockAt(edit.position);
+    const int last = edit.removed > 0 ? qMax(first, blockAt(edit.position + edit.removed - 1)) : first;
+    const int lastEnd = blocks.at(last).start + blocks.at(last).length;
+    while (first > 0 && edit.position - blocks.at(first).start < 2)
+        --first;
+
+    Block merged;
+    merged.start = blocks.at(first).start;
+    merged.length = lastEnd - merged.start - edit.removed + edit.added;
+    merged.dirty = true;
+    blocks[first] = merged;
+    blocks.remove(first + 1, last - first);
+    const int delta = edit.added - edit.removed;
+    if (delta != 0) {
+        Block *block = blocks.data();
+        for (int i = first + 1; i < blocks.size(); ++i)
+            block[i].start += delta;
+    }
+    if (merged.length > 0)
+        return first;
+    blocks.remove(first);
+    return -1;
+}
+
+/* Signs the dirty block i from the current text; typing grows a block, it is cut back
+   to the usual size once it doubled. Returns the index of the block after it */
+int TrigramIndex::refresh(int i) {
+    int start = blocks.at(i).start;
+    const int length = blocks.at(i).length;
+    const int piece = length > 2 * blockChars ? blockChars : length;
+    blocks.remove(i);
+    for (int offset = 0; offset < length; offset += piece, ++i) {
+        Block block;
+        block.start = start;
+        block.length = qMin(piece, length - offset);
+        block.dirty = false;
+        block.signature = signatureOf(text->text(start, block.length + 2), block.length);
+        blocks.insert(i, block);
+        start += block.length;
+    }
+    return i;
+}
+
+void TrigramIndex::refreshAll() {
+    for (int i = 0; i < blocks.size();)
+        i = blocks.at(i).dirty ? refresh(i) : i + 1;
+}
+
+bool TrigramIndex::candidates(const QString &pattern, QVector<SearchRange> *ranges) const {
+    ranges->clear();
+    if (!built || pattern.size() < 3)
+        return false;
+
+    QVector<uint> bits;
+    ushort a = foldCase(pattern.at(0).unicode());
+    ushort b = foldCase(pattern.at(1).unicode());
+    for (int i = 2; i < pattern.size(); ++i) {
+        const ushort c = foldCase(pattern.at(i).unicode());
+        bits.append(trigramBit(a, b, c));
+        a = b;
+        b = c;
+    }
+    std::sort(bits.begin(), bits.end());
+    bits.erase(std::unique(bits.begin(), bits.end()), bits.end());
+
+    // A match starting in block i has each trigram in block i or in the blocks
+    // that follow, as long as they start less than the pattern length away
+    const int patternLength = pattern.size();
+    int start = 0;
+    for (int i = 0; i < blocks.size(); ++i) {
+        bool candidate = true;
+        for (int j = 0; candidate && j < bits.size(); ++j) {
+            const uint bit = bits.at(j);
+            candidate = false;
+            int covered = 0;
+            for (int k = i; k < blocks.size() && !candidate; ++k) {
+                candidate = blocks.at(k).signature.at(int(bit >> 6)) & (quint64(1) << (bit & 63));
+                if (k > i)
+                    covered += blocks.at(k).length;
+                if (covered >= patternLength)
+                    break;
+            }
+        }
+
+        const int length = blocks.at(i).length;
+        if (candidate) {
+            if (!ranges->isEmpty() && ranges->last().end == start)
+                ranges->last().end += length;
+            else
+                ranges->append({start, start + length});
+        }
+        start += length;
+    }
+    return true;
+}
+
+qint64 TrigramIndex::memoryUsage() const {
+    return qint64(blocks.capacity()) * sizeof(Block)
+           + qint64(blocks.size()) * (signatureWords * sizeof(quint64) + sizeof(QArrayData));
+}
@@ -0,0 +1,70 @@
+#ifndef TRIGRAMINDEX_HPP
+#define TRIGRAMINDEX_HPP
+
+#include <QObject>
+#include <QVector>
+#include <QFutureWatcher>
+#include "piecetable.hpp"
+#include "textsearch.hpp"
+
+/* Index de trigrammes du texte entier, par blocs d'environ 4 K caractères : chaque bloc
+   garde la signature (un bit par trigramme haché, en casse repliée) des trigrammes qui
+   y commencent. Une requête ne vérifie que les blocs dont la signature contient tous
+   ses trigrammes. Construit en arrière-plan, puis tenu à jour bloc par bloc */
+class TrigramIndex : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit TrigramIndex(const PieceTable *text, QObject *parent = nullptr);
+
+    /* Reconstruire l'index du texte actuel en arrière-plan */
+    void build();
+    void clear();
+    bool isReady() const;
+    /* Le texte a changé, en positions du texte entier ; seuls les blocs touchés sont refaits */
+    void textChanged(int position, int removed, int added);
+    /* Plages où une occurrence de pattern peut commencer, vide si aucune ; faux si
+       l'index ne peut pas restreindre la recherche (motif trop court, index pas prêt) */
+    bool candidates(const QString &pattern, QVector<SearchRange> *ranges) const;
+    qint64 memoryUsage() const;
+
+signals:
+    void ready();
+
+private slots:
+    void buildFinished();
+
+public:
+    struct Block
+    {
+        /* Position du premier caractère dans le texte, pour trouver un bloc par dichotomie */
+        int start;
+        int length;
+        bool dirty;
+        QVector<quint64> signature;
+    };
+
+private:
+    struct Edit
+    {
+        int position;
+        int removed;
+        int added;
+    };
+
+    int blockAt(int position) const;
+    int adjust(const Edit &edit);
+    int refresh(int i);
+    void refreshAll();
+
+    const PieceTable *text;
+    QVector<Block> blocks;
+    /* Modifications reçues pendant la construction, appliquées à la fin */
+    QVector<Edit> pendingEdits;
+    QFutureWatcher<QVector<Block>> *watcher;
+    bool building;
+    bool built;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include "updatescheduler.hpp"
+#include <QTimer>
+#include <QGuiApplication>
+#include <QScreen>
+
+UpdateScheduler::UpdateScheduler(QObject *parent)
+        : QObject(parent), timer(new QTimer(this)), requests(0), runs(0) {
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, &QTimer::timeout, this, &UpdateScheduler::flush);
+    clock.start();
+}
+
+int UpdateScheduler::addTask(const std::function<void()> &task) {
+    tasks.append(task);
+    pending.append(false);
+    return tasks.size() - 1;
+}
+
+void UpdateScheduler::schedule(int task) {
+    ++requests;
+    pending[task] = true;
+    if (timer->isActive())
+        return;
+    // Ticks fall on a fixed grid, so a burst of requests waits at most one frame
+    const int interval = frameInterval();
+    timer->start(interval - int(clock.elapsed() % interval));
+}
+
+void UpdateScheduler::flush() {
+    timer->stop();
+    for (int i = 0; i < tasks.size(); ++i) {
+        if (!pending.at(i))
+            continue;
+        pending[i] = false;
+        ++runs;
+        tasks.at(i)();
+    }
+}
+
+quint64 UpdateScheduler::requestCount() const {
+    return requests;
+}
+
+quint64 UpdateScheduler::runCount() const {
+    return runs;
+}
+
+quint64 UpdateScheduler::coalescedCount() const {
+    return requests - runs;
+}
+
+int UpdateScheduler::frameInterval() const {
+    const QScreen *screen = QGuiApplication::primaryScreen();
+    const qreal rate = screen ? screen->refreshRate() : 60;
+    return qMax(1, qRound(1000 / (rate > 0 ? rate : 60)));
+}
@@ -0,0 +1,42 @@
+#ifndef UPDATESCHEDULER_HPP
+#define UPDATESCHEDULER_HPP
+
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+#include <functional>
+
+class QTimer;
+
+/* Regroupe les mises à jour d'affichage : une tâche demandée plusieurs fois pendant une
+   image ne s'exécute qu'une fois, au prochain tick calé sur la fréquence de l'écran */
+class UpdateScheduler : public QObject
+{
+Q_OBJECT
+
+public:
+    explicit UpdateScheduler(QObject *parent = nullptr);
+
+    /* Enregistrer une tâche, renvoie son identifiant pour schedule() */
+    int addTask(const std::function<void()> &task);
+    void schedule(int task);
+    /* Exécuter tout de suite les tâches en attente */
+    void flush();
+
+    /* Demandes reçues, exécutions faites, et demandes absorbées par une exécution déjà prévue */
+    quint64 requestCount() const;
+    quint64 runCount() const;
+    quint64 coalescedCount() const;
+
+private:
+    int frameInterval() const;
+
+    QTimer *timer;
+    QElapsedTimer clock;
+    QVector<std::function<void()>> tasks;
+    QVector<bool> pending;
+    quint64 requests;
+    quint64 runs;
+};
+
+#endif
@@ -1,4 +1,19 @@
 #include "window.hpp"
+#include "fileloader.hpp"
+#include "filesaver.hpp"
+#include "editjournal.hpp"
+#include "nativeformat.hpp"
+#include "compression.hpp"
+#include "updatescheduler.hpp"
+#include "documentstatistics.hpp"
+#include "wordcount.hpp"
+#include "findbar.hpp"
+#include "trigramindex.hpp"
+#include "findinfiles.hpp"
+#include "regexreplace.hpp"
+#include "batchreplace.hpp"
+#include "spellhighlighter.hpp"
+#include "spellcache.hpp"
 #include <QtWidgets>
 #include <QPushButton>
 #include <QSessionManager>
@@ -9,12 +24,36 @@
 #include <QPainter>
 #include <QTextBlock>
 #include <QScrollBar>
+#include <algorithm>
+
+// Files from this size on are opened in large file mode, see LineNumberTextEdit::setLargeText
+static const qint64 largeFileThreshold = 32 * 1024 * 1024;
+// Documents from this length on get a trigram index for the find bar
+static const int searchIndexThreshold = 1024 * 1024;
+// A replacement preview still running after this long is given up, and replacements previewed at most
+static const int matchTimeoutMs = 3000;
+static const int previewedReplacements = 20;
+// Edits longer than this, such as pasting a file, are searched again in the background
+static const int localRescanLimit = 64 * 1024;
+// Past this many edits in one batched replacement of large file mode, or in its undo, the
+// search index is built again once rather than updated around each edit
+static const int reindexReplacements = 64;
+// Replace-all offers to cancel a scan still running after this long
+static const int replaceProgressDelayMs = 500;
 // Load dictionary for spelling, to be sure where it is located type hunspell -D
 Hunspell spellChecker("/usr/share/hunspell/en_US.aff", "/usr/share/hunspell/en_US.dic");
+// Every lookup goes through the cache, which also serialises the calls to Hunspell
+static SpellCache spellCache(&spellChecker);
 
 MainWindow::MainWindow() : textEdit(new LineNumberTextEdit), lineNumberArea(new QWidget(this)), fontSize(14) {
     setCentralWidget(textEdit);
 
+    createStatisticsDock();
+    createFindBar();
+    createFindInFilesDock();
+    // Misspellings are underlined as the text changes, the words are checked on a worker thread
+    spellHighlighter = new SpellHighlighter(&spellCache, textEdit->document());
+    connect(textEdit, &LineNumberTextEdit::documentRefilled, spellHighlighter, &SpellHighlighter::recheckAll);
     createActions();
     createStatusBar();
 
@@ -23,9 +62,22 @@ MainWindow::MainWindow() : textEdit(new LineNumberTextEdit), lineNumberArea(new
     connect(textEdit->document(), &QTextDocument::contentsChanged,
             this, &MainWindow::documentWasModified);
 
+    // Background loading
+    fileLoader = new FileLoader(this);
+    loadingLargeFile = false;
+    connect(fileLoader, &FileLoader::progress, this, &MainWindow::loadProgress);
+    connect(fileLoader, &FileLoader::finished, this, &MainWindow::loadFinished);
+
+    // Background saving
+    fileSaver = new FileSaver(this);
+    connect(fileSaver, &FileSaver::finished, this, &MainWindow::saveFinished);
+
     // Auto save
     autoSaveTimer = new QTimer(this);
     connect(autoSaveTimer, &QTimer::timeout, this, &MainWindow::autoSave);
+    journal = new EditJournal(this);
+    connect(textEdit, &LineNumberTextEdit::textBufferChanged, journal, &EditJournal::recordChange);
+    connect(journal, &EditJournal::idle, this, &MainWindow::compactJournal);
 
     // Word count
     wordCountLabel = new QLabel(this);
@@ -36,7 +88,24 @@ MainWindow::MainWindow() : textEdit(new LineNumberTextEdit), lineNumberArea(new
     statusBar()->addPermanentWidget(charCountLabel);
     statusBar()->addPermanentWidget(lineCountLabel);
 
-    connect(textEdit, &QTextEdit::textChanged, this, &MainWindow::updateCounts);
+    // Labels, margins and the current line highlight are refreshed once per frame,
+    // however many changes and cursor moves came in meanwhile
+    viewUpdates = new UpdateScheduler(this);
+    countsTask = viewUpdates->addTask([this]() { updateCounts(); });
+    currentLineTask = viewUpdates->addTask([this]() { highlightCurrentLine(); });
+    // The text edit sizes its line number margin on cursor moves, scrolling and new blocks
+    textEdit->setUpdateScheduler(viewUpdates);
+    connect(textEdit, &QTextEdit::textChanged, this, [this]() {
+        countedStart = -1;
+        viewUpdates->schedule(countsTask);
+    });
+    // Counts follow the selection while it is dragged, once per frame
+    countedStart = -1;
+    countedEnd = -1;
+    countedWords = 0;
+    connect(textEdit, &QTextEdit::selectionChanged, this, [this]() {
+        viewUpdates->schedule(countsTask);
+    });
 
     updateCounts();
 
@@ -60,9 +129,11 @@ MainWindow::MainWindow() : textEdit(new LineNumberTextEdit), lineNumberArea(new
     setUnifiedTitleAndToolBarOnMac(true);
 
     lineNumberArea = new QWidget(this);
-    connect(textEdit, &QTextEdit::textChanged, this, &MainWindow::updateLineNumberAreaWidth);
-    connect(textEdit, &LineNumberTextEdit::textChanged, this, &MainWindow::updateLineNumberAreaWidth);
-    connect(textEdit, &LineNumberTextEdit::cursorPositionChanged, this, &MainWindow::highlightCurrentLine);
+    connect(textEdit, &LineNumberTextEdit::cursorPositionChanged, this, [this]() {
+        viewUpdates->schedule(currentLineTask);
+        if (!searchResult.matches.isEmpty())
+            updateFindStatus();
+    });
     highlightCurrentLine();
 
     connect(textEdit, &LineNumberTextEdit::linkClicked, this, &MainWindow::onAnchorClicked);
@@ -76,7 +147,15 @@ MainWindow::MainWindow() : textEdit(new LineNumberTextEdit), lineNumberArea(new
 
 void MainWindow::closeEvent(QCloseEvent *event) {
     if (maybeSave()) {
+        fileLoader->cancel();
+        // Keep the window open if a write that was still running failed
+        if (!fileSaver->waitForFinished()) {
+            event->ignore();
+            return;
+        }
         writeSettings();
+        // Saved or discarded, the journal has nothing left to keep
+        journal->discard();
         event->accept();
     } else {
         event->ignore();
@@ -85,16 +164,25 @@ void MainWindow::closeEvent(QCloseEvent *event) {
 
 void MainWindow::newFile() {
     if (maybeSave()) {
+        fileLoader->cancel();
         textEdit->clear();
+        textEdit->documentLoaded();
+        updateCounts();
+        fileFormat = TextFileFormat();
         setCurrentFile(QString());
+        journal->discard();
+        rebuildSearchIndex();
     }
 }
 
 void MainWindow::open() {
     if (maybeSave()) {
         QString fileName = QFileDialog::getOpenFileName(this);
-        if (!fileName.isEmpty())
+        if (!fileName.isEmpty()) {
+            // The load in progress is only given up once there is a file to replace it
+            fileLoader->cancel();
             loadFile(fileName);
+        }
     }
 }
 
@@ -129,11 +217,82 @@ bool MainWindow::saveAs() {
 
 void MainWindow::autoSave() {
     if (!curFile.isEmpty()) {
-        save();
+        // Only the edits made since the last run are appended to the journal
+        journal->flush();
         autoSaveTimer->start(30000);
     }
 }
 
+void MainWindow::compactJournal() {
+    if (!curFile.isEmpty() && !fileLoader->isLoading())
+        save();
+}
+
+bool MainWindow::restoreFromJournal() {
+    const QStringList journals = EditJournal::orphanedJournals();
+    bool restored = false;
+    for (const QString &journalFile : journals) {
+        JournalReplay replay;
+        QString errorString;
+        if (!EditJournal::replay(journalFile, &replay, &errorString)) {
+            QMessageBox::warning(this, tr("Application"),
+                                 tr("Cannot recover unsaved changes:\n%1.").arg(errorString));
+            QFile::remove(journalFile);
+            continue;
+        }
+
+        const QString shownName = replay.documentFile.isEmpty()
+                                  ? tr("an untitled document")
+                                  : QDir::toNativeSeparators(replay.documentFile);
+        const QMessageBox::StandardButton ret
+                = QMessageBox::question(this, tr("Application"),
+                                        tr("The application was not closed properly while editing %1.\n"
+                                           "Do you want to restore the unsaved changes (%2 edits)?")
+                                                .arg(shownName).arg(replay.operations),
+                                        QMessageBox::Yes | QMessageBox::No);
+        if (ret != QMessageBox::Yes) {
+            QFile::remove(journalFile);
+            continue;
+        }
+
+        // The first document comes back in this window, each further one in a window of its own
+        MainWindow *window = this;
+        if (restored) {
+            window = new MainWindow;
+            window->setAttribute(Qt::WA_DeleteOnClose);
+            window->show();
+        }
+        window->restoreReplay(journalFile, replay);
+        restored = true;
+    }
+    return restored;
+}
+
+void MainWindow::restoreReplay(const QString &journalFile, const JournalReplay &replay) {
+    // The journal already holds these edits, they must not be recorded again
+    if (replay.text.size() >= largeFileThreshold) {
+        textEdit->setLargeText(replay.text);
+    } else {
+        {
+            const QSignalBlocker blocker(textEdit->document());
+            textEdit->setPlainText(replay.text);
+        }
+        textEdit->documentLoaded();
+    }
+    updateCounts();
+    rebuildSearchIndex();
+    // Only the text is journaled, saving it as-is would drop the formatting of a native file
+    const bool formatted = NativeFormat::isNativeFile(replay.documentFile);
+    fileFormat = replay.format;
+    setCurrentFile(formatted ? QString() : replay.documentFile);
+    journal->adopt(journalFile, replay.documentFile, replay.validBytes);
+    textEdit->document()->setModified(true);
+    setWindowModified(true);
+    if (!curFile.isEmpty())
+        autoSaveTimer->start(30000);
+    statusBar()->showMessage(tr("Unsaved changes restored"), 2000);
+}
+
 void MainWindow::about() {
     QMessageBox::about(this, tr("About Application"),
                        tr("The Office Application is a desktop application built using Qt and C++ programming language. It is designed to provide similar functionality as LibreOffice. \nThe application offers various features such as :\n"
@@ -157,6 +316,8 @@ void MainWindow::createStatusBar() {
 void MainWindow::writeSettings() {
     QSettings settings(QCoreApplication::organizationName(), QCoreApplication::applicationName());
     settings.setValue("geometry", saveGeometry());
+    settings.setValue("indexLargeDocuments", indexSearchAct->isChecked());
+    settings.setValue("checkSpellingAsYouType", spellAsYouTypeAct->isChecked());
 }
 
 void MainWindow::readSettings() {
@@ -170,10 +331,13 @@ void MainWindow::readSettings() {
     } else {
         restoreGeometry(geometry);
     }
+    indexSearchAct->setChecked(settings.value("indexLargeDocuments", true).toBool());
+    spellAsYouTypeAct->setChecked(settings.value("checkSpellingAsYouType", true).toBool());
 }
 
 bool MainWindow::maybeSave() {
-    if (!textEdit->document()->isModified())
+    // A document still loading has nothing to save, the caller cancels the load once confirmed
+    if (fileLoader->isLoading() || !textEdit->document()->isModified())
         return true;
     const QMessageBox::StandardButton ret
             = QMessageBox::warning(this, tr("Application"),
@@ -192,30 +356,134 @@ bool MainWindow::maybeSave() {
 }
 
 void MainWindow::loadFile(const QString &fileName) {
-    QFile file(fileName);
-    if (!file.open(QFile::ReadOnly | QFile::Text)) {
+    // A pending auto save would write the half loaded document over the old file
+    autoSaveTimer->stop();
+
+    if (NativeFormat::isNativeFile(fileName)) {
+        loadNativeFile(fileName);
+        return;
+    }
+
+    // Large files stay out of the document, only the lines on screen are laid out
+    loadingLargeFile = contentSize(fileName) >= largeFileThreshold;
+    const bool started = loadingLargeFile ? fileLoader->startText(fileName)
+                                          : fileLoader->start(fileName, textEdit->document());
+    if (!started) {
+        lineAfterLoad = -1;
         QMessageBox::warning(this, tr("Application"),
                              tr("Cannot read file %1:\n%2.")
-                                     .arg(QDir::toNativeSeparators(fileName), file.errorString()));
+                                     .arg(QDir::toNativeSeparators(fileName), fileLoader->errorString()));
         return;
     }
 
-    QTextStream in(&file);
-#ifndef QT_NO_CURSOR
-    QGuiApplication::setOverrideCursor(Qt::WaitCursor);
-#endif
-    textEdit->setPlainText(in.readAll());
-#ifndef QT_NO_CURSOR
-    QGuiApplication::restoreOverrideCursor();
-#endif
+    // The view stays scrollable while batches are appended behind the cursor
+    QTextCursor cursor = textEdit->textCursor();
+    cursor.setKeepPositionOnInsert(true);
+    textEdit->setTextCursor(cursor);
+    textEdit->setReadOnly(true);
+    cancelLoadAct->setEnabled(true);
+    setWindowFilePath(fileName);
+}
 
+void MainWindow::loadNativeFile(const QString &fileName) {
+    QFile file(fileName);
+    QString errorString;
+    QMap<int, QString> comments;
+    bool ok = file.open(QFile::ReadOnly);
+    if (!ok)
+        errorString = file.errorString();
+
+    if (ok) {
+        // Same as the text loader: one refresh of the views and counters at the end
+        QTextDocument *document = textEdit->document();
+        const QSignalBlocker blocker(document);
+        document->setUndoRedoEnabled(false);
+        ok = NativeFormat::read(&file, document, &comments, &errorString);
+        document->setUndoRedoEnabled(true);
+    }
+    textEdit->setComments(comments);
+    textEdit->documentLoaded();
+    updateCounts();
+    highlightCurrentLine();
+    rebuildSearchIndex();
+
+    if (!ok) {
+        lineAfterLoad = -1;
+        setCurrentFile(QString());
+        QMessageBox::warning(this, tr("Application"),
+                             tr("Cannot read file %1:\n%2.")
+                                     .arg(QDir::toNativeSeparators(fileName), errorString));
+        return;
+    }
+    fileFormat = TextFileFormat();
     setCurrentFile(fileName);
     statusBar()->showMessage(tr("File loaded"), 2000);
-    autoSave(); // Save the file immediately after opening
+    autoSaveTimer->start(30000);
+    if (lineAfterLoad >= 0)
+        textEdit->goToLine(lineAfterLoad);
+    lineAfterLoad = -1;
+}
+
+void MainWindow::loadProgress(qint64 bytesLoaded, qint64 totalBytes, qint64 linesLoaded) {
+    statusBar()->showMessage(tr("Loading... %1 / %2 MB, %3 lines")
+                                     .arg(bytesLoaded / (1024 * 1024))
+                                     .arg(totalBytes / (1024 * 1024))
+                                     .arg(linesLoaded));
+}
+
+void MainWindow::loadFinished(bool completed) {
+    QTextCursor cursor = textEdit->textCursor();
+    cursor.setKeepPositionOnInsert(false);
+    textEdit->setTextCursor(cursor);
+    textEdit->setReadOnly(false);
+    cancelLoadAct->setEnabled(false);
+
+    if (loadingLargeFile && completed) {
+        textEdit->setLargeText(fileLoader->takeText());
+    } else {
+        // A cancelled large file leaves the previous document, which was already given up
+        if (loadingLargeFile)
+            textEdit->clear();
+        textEdit->documentLoaded();
+    }
+    updateCounts();
+    highlightCurrentLine();
+    rebuildSearchIndex();
+
+    // Saving writes the encoding and line endings back as they were read
+    fileFormat = completed ? fileLoader->format() : TextFileFormat();
+    if (completed) {
+        setCurrentFile(fileLoader->fileName());
+        if (textEdit->isLargeFile())
+            statusBar()->showMessage(tr("Large file mode: %1 lines").arg(textEdit->lineCount()), 5000);
+        else
+            statusBar()->showMessage(tr("File loaded"), 2000);
+        autoSaveTimer->start(30000);
+        if (lineAfterLoad >= 0)
+            textEdit->goToLine(lineAfterLoad);
+        lineAfterLoad = -1;
+        return;
+    }
+
+    // A partial document must never be saved over the original file
+    lineAfterLoad = -1;
+    setCurrentFile(QString());
+    if (fileLoader->errorString().isEmpty()) {
+        statusBar()->showMessage(tr("Loading cancelled"), 2000);
+    } else {
+        QMessageBox::warning(this, tr("Application"),
+                             tr("Cannot read file %1:\n%2.")
+                                     .arg(QDir::toNativeSeparators(fileLoader->fileName()), fileLoader->errorString()));
+    }
+}
+
+void MainWindow::cancelLoad() {
+    fileLoader->cancel();
 }
 
 void MainWindow::setCurrentFile(const QString &fileName) {
     curFile = fileName;
+    journal->setFileName(fileName);
     textEdit->document()->setModified(false);
     setWindowModified(false);
 
@@ -239,6 +507,7 @@ void MainWindow::commitData(QSessionManager &manager) {
         // Non-interactive: save without asking
         if (textEdit->document()->isModified())
             save();
+        fileSaver->waitForFinished();
     }
 }
 
@@ -246,27 +515,42 @@ void MainWindow::commitData(QSessionManager &manager) {
 
 bool MainWindow::saveFile(const QString &fileName)
 {
-    QFile file(fileName);
-    if (!file.open(QFile::WriteOnly | QFile::Text)) {
-        QMessageBox::warning(this, tr("Application"),
-                             tr("Cannot write file %1:\n%2.")
-                                     .arg(QDir::toNativeSeparators(fileName),
-                                          file.errorString()));
-        return false;
+    // The journal stays until the write succeeds, a Save As that fails keeps the edits recoverable
+    journal->beginCompaction(fileName);
+    setCurrentFile(fileName);
+
+    // Only the snapshot is taken here, encoding and writing run on the saver thread
+    if (NativeFormat::isNativeFile(fileName)) {
+        // In large file mode the document only holds the lines on screen, the saver
+        // builds one from the buffer snapshot on its own thread
+        if (textEdit->isLargeFile())
+            fileSaver->saveDocument(fileName, textEdit->textBuffer().snapshot(), textEdit->allComments());
+        else
+            fileSaver->saveDocument(fileName, textEdit->document()->clone(), textEdit->allComments());
+    } else {
+        fileSaver->save(fileName, textEdit->textBuffer().snapshot(), fileFormat);
     }
+    statusBar()->showMessage(tr("Saving..."));
+    return true;
+}
 
-    QTextStream out(&file);
-#ifndef QT_NO_CURSOR
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-#endif
-    out << textEdit->toPlainText();
-#ifndef QT_NO_CURSOR
-    QApplication::restoreOverrideCursor();
-#endif
+void MainWindow::saveFinished(const QString &fileName, bool ok, const QString &errorString)
+{
+    journal->endCompaction(fileName, ok);
+    if (ok) {
+        statusBar()->showMessage(tr("File saved"), 2000);
+        return;
+    }
 
-    setCurrentFile(fileName);
-    statusBar()->showMessage(tr("File saved"), 2000);
-    return true;
+    // The document no longer matches what is on disk
+    if (fileName == curFile) {
+        textEdit->document()->setModified(true);
+        setWindowModified(true);
+    }
+    statusBar()->clearMessage();
+    QMessageBox::warning(this, tr("Application"),
+                         tr("Cannot write file %1:\n%2.")
+                                 .arg(QDir::toNativeSeparators(fileName), errorString));
 }
 
 void MainWindow::bold() {
@@ -506,37 +790,508 @@ void MainWindow::lowercase()
 }
 
 void MainWindow::updateCounts() {
-    QString text = textEdit->toPlainText();
-    int wordCount = text.split(QRegularExpression(R"((\s|\n|\r)+)"), QString::SkipEmptyParts).count();
-    int charCount = text.length();
-    int lineCount = text.count('\n') + 1;
+    // The text edit keeps the counts current as the text changes, nothing is rescanned here
+    const PieceTable &buffer = textEdit->textBuffer();
+    int wordCount = textEdit->wordCount();
+    int charCount = buffer.length();
+    int lineCount = buffer.lineCount();
+
+    int start, end;
+    textEdit->selectionRange(&start, &end);
+    if (start == end) {
+        wordCountLabel->setText(tr("Words: %1").arg(wordCount));
+        charCountLabel->setText(tr("Characters: %1").arg(charCount));
+        lineCountLabel->setText(tr("Lines: %1").arg(lineCount));
+        return;
+    }
+
+    // A selection starting inside a word still counts that word
+    int selectedWords = selectionWordStarts(start, end);
+    if (start > 0 && !isAsciiSpace(buffer.at(start).unicode()) && !isAsciiSpace(buffer.at(start - 1).unicode()))
+        ++selectedWords;
+    const int selectedLines = buffer.lineAt(end - 1) - buffer.lineAt(start) + 1;
 
-    wordCountLabel->setText(tr("Words: %1").arg(wordCount));
-    charCountLabel->setText(tr("Characters: %1").arg(charCount));
-    lineCountLabel->setText(tr("Lines: %1").arg(lineCount));
+    wordCountLabel->setText(tr("Words: %1 of %2").arg(selectedWords).arg(wordCount));
+    charCountLabel->setText(tr("Characters: %1 of %2").arg(end - start).arg(charCount));
+    lineCountLabel->setText(tr("Lines: %1 of %2").arg(selectedLines).arg(lineCount));
 }
 
-void MainWindow::searchReplaceFunction(const QString &search, const QString &replace, bool findWholeWords) {
-    QTextCursor cursor = textEdit->textCursor();
-    cursor.beginEditBlock();
-    QRegularExpression regex;
-    if (findWholeWords) {
-        regex.setPattern("\\b" + QRegularExpression::escape(search) + "\\b");
+/* Word starts in [start, end). While the user drags, one end of the selection stays
+   put: only the stretch between the old and the new other end is counted. */
+int MainWindow::selectionWordStarts(int start, int end) {
+    const PieceTable &buffer = textEdit->textBuffer();
+    if (countedStart >= 0 && start == countedStart) {
+        countedWords += end >= countedEnd ? buffer.wordStarts(countedEnd, end) : -buffer.wordStarts(end, countedEnd);
+    } else if (countedStart >= 0 && end == countedEnd) {
+        countedWords += start <= countedStart ? buffer.wordStarts(start, countedStart)
+                                              : -buffer.wordStarts(countedStart, start);
     } else {
-        regex.setPattern(QRegularExpression::escape(search));
-    }
-    cursor.movePosition(QTextCursor::Start);
-    while (!cursor.isNull() && !cursor.atEnd()) {
-        QRegularExpressionMatch match = regex.match(textEdit->toPlainText(), cursor.position());
-        if (match.hasMatch()) {
-            cursor.setPosition(match.capturedStart());
-            cursor.setPosition(match.capturedEnd(), QTextCursor::KeepAnchor);
-            cursor.insertText(replace);
-        } else {
-            break;
+        countedWords = buffer.wordStarts(start, end);
+    }
+    countedStart = start;
+    countedEnd = end;
+    return countedWords;
+}
+
+void MainWindow::createStatisticsDock() {
+    statisticsDock = new QDockWidget(tr("Statistics"), this);
+    statisticsDock->setObjectName("statisticsDock");
+    statisticsLabel = new QLabel(statisticsDock);
+    statisticsLabel->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+    statisticsLabel->setMargin(6);
+    statisticsDock->setWidget(statisticsLabel);
+    addDockWidget(Qt::RightDockWidgetArea, statisticsDock);
+    statisticsDock->hide();
+
+    // Recomputed once typing pauses, and only while the panel is shown
+    statisticsStale = false;
+    statisticsWatcher = new QFutureWatcher<DocumentStatistics>(this);
+    connect(statisticsWatcher, &QFutureWatcher<DocumentStatistics>::finished, this, &MainWindow::statisticsFinished);
+    statisticsTimer = new QTimer(this);
+    statisticsTimer->setSingleShot(true);
+    statisticsTimer->setInterval(1000);
+    connect(statisticsTimer, &QTimer::timeout, this, &MainWindow::updateStatistics);
+    connect(textEdit, &QTextEdit::textChanged, this, [this]() {
+        if (statisticsDock->isVisible())
+            statisticsTimer->start();
+    });
+    connect(statisticsDock, &QDockWidget::visibilityChanged, this, [this](bool visible) {
+        if (visible)
+            updateStatistics();
+    });
+}
+
+void MainWindow::updateStatistics() {
+    // The running computation works on its own snapshot, a newer one follows it
+    if (statisticsWatcher->isRunning()) {
+        statisticsStale = true;
+        return;
+    }
+    statisticsStale = false;
+    statisticsWatcher->setFuture(computeStatistics(textEdit->textBuffer()));
+}
+
+void MainWindow::statisticsFinished() {
+    if (statisticsStale) {
+        updateStatistics();
+        return;
+    }
+
+    const DocumentStatistics stats = statisticsWatcher->result();
+    const SpellCache::Statistics spelling = spellCache.statistics();
+    QString longest;
+    for (const DocumentStatistics::Paragraph &paragraph : stats.longestParagraphs)
+        longest += tr("<br>&nbsp;&nbsp;Line %1: %2 words").arg(paragraph.line + 1).arg(paragraph.words);
+
+    statisticsLabel->setText(tr("<b>Words:</b> %1<br><b>Unique words:</b> %2<br>"
+                                "<b>Sentences:</b> %3<br><b>Average sentence:</b> %4 words<br>"
+                                "<b>Paragraphs:</b> %5<br><b>Reading time:</b> %6 min<br>"
+                                "<b>Longest paragraphs:</b>%7<br>"
+                                "<b>Spelling cache:</b> %8% hits, %9 words<br>"
+                                "<b>View updates:</b> %10 requested, %11 run, %12 coalesced")
+                                     .arg(stats.words)
+                                     .arg(stats.vocabulary.size())
+                                     .arg(stats.sentences)
+                                     .arg(stats.averageSentenceLength(), 0, 'f', 1)
+                                     .arg(stats.paragraphs)
+                                     .arg(qCeil(stats.readingMinutes()))
+                                     .arg(longest)
+                                     .arg(spelling.hitRate() * 100, 0, 'f', 1)
+                                     .arg(spelling.words)
+                                     .arg(viewUpdates->requestCount())
+                                     .arg(viewUpdates->runCount())
+                                     .arg(viewUpdates->coalescedCount()));
+}
+
+/* Plain text goes through the literal matcher, the same search as the find bar; regular
+   expressions through the cached compiled pattern. An invalid pattern gives no scan */
+static QFuture<ReplaceScan> startReplacements(const PieceTable &buffer, const QString &search, const QString &replace,
+                                              bool findWholeWords, bool regexMode, int limit,
+                                              const SearchCancel &cancel, QString *errorString)
+{
+    if (!regexMode) {
+        SearchQuery query;
+        query.pattern = search;
+        query.caseSensitivity = Qt::CaseSensitive;
+        query.wholeWords = findWholeWords;
+        return startReplaceScan(buffer, query, replace, limit, cancel);
+    }
+
+    QString pattern = search;
+    if (findWholeWords)
+        pattern = "\\b(?:" + pattern + ")\\b";
+    // ^ and $ are line anchors, as in other editors
+    const QRegularExpression regex = cachedRegularExpression(pattern, QRegularExpression::MultilineOption);
+    if (!regex.isValid()) {
+        *errorString = regex.errorString();
+        return QFuture<ReplaceScan>();
+    }
+    return startReplaceScan(buffer, regex, replace, true, limit, cancel);
+}
+
+void MainWindow::searchReplaceFunction(const QString &search, const QString &replace, bool findWholeWords,
+                                       bool regexMode) {
+    if (search.isEmpty())
+        return;
+
+    // One scan finds every match, off the GUI thread so that a long scan, or a
+    // pattern which backtracks for too long, can be cancelled
+    const SearchCancel cancel = std::make_shared<QAtomicInt>(0);
+    QString errorString;
+    const QFuture<ReplaceScan> scan = startReplacements(textEdit->textBuffer(), search, replace, findWholeWords,
+                                                        regexMode, -1, cancel, &errorString);
+    if (!errorString.isEmpty()) {
+        QMessageBox::warning(this, tr("Search and Replace"),
+                             tr("Invalid regular expression:\n%1.").arg(errorString));
+        return;
+    }
+    QFutureWatcher<ReplaceScan> watcher;
+    QEventLoop loop;
+    connect(&watcher, &QFutureWatcher<ReplaceScan>::finished, &loop, &QEventLoop::quit);
+    QTimer::singleShot(replaceProgressDelayMs, &loop, &QEventLoop::quit);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    watcher.setFuture(scan);
+    // No input meanwhile, the positions must still hold when the replacements are made
+    loop.exec(QEventLoop::ExcludeUserInputEvents);
+    QApplication::restoreOverrideCursor();
+    if (!watcher.isFinished()) {
+        // A longer scan runs to its end unless the user cancels it; the modal dialog
+        // keeps every window, and so the document, still until then
+        QProgressDialog progress(tr("Finding the matches to replace..."), tr("Cancel"), 0, 0, this);
+        progress.setWindowTitle(tr("Search and Replace"));
+        progress.setWindowModality(Qt::ApplicationModal);
+        progress.setMinimumDuration(0);
+        connect(&progress, &QProgressDialog::canceled, &loop, &QEventLoop::quit);
+        progress.show();
+        loop.exec();
+        if (!watcher.isFinished()) {
+            // The scan stops at its next window or match and frees its pool thread
+            cancel->storeRelease(1);
+            statusBar()->showMessage(tr("Replace All cancelled, nothing was replaced"), 5000);
+            return;
         }
     }
-    cursor.endEditBlock();
+
+    applyReplacements(watcher.result().matches);
+}
+
+bool MainWindow::applyReplacements(const QVector<ReplaceMatch> &matches) {
+    // The replacements go from the last match back so the earlier positions stay valid
+    if (matches.isEmpty())
+        return true;
+    qint64 length = textEdit->textBuffer().length();
+    for (const ReplaceMatch &match : matches)
+        length += match.replacement.size() - match.length;
+    if (length > PieceTable::maxLength) {
+        QMessageBox::warning(this, tr("Search and Replace"),
+                             tr("Nothing was replaced: the text would grow past %L1 characters.")
+                                     .arg(PieceTable::maxLength));
+        return false;
+    }
+    // The find bar searches again once, not around each replacement
+    if (findBar->isVisible())
+        searchTimer->start();
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    if (textEdit->isLargeFile()) {
+        // Most of the text is outside the document: one pass over the buffer, one undo step
+        textEdit->replaceRanges(matches);
+    } else {
+        replaceInDocument(textEdit->textCursor(), matches);
+    }
+    QApplication::restoreOverrideCursor();
+    return true;
+}
+
+void MainWindow::batchReplace() {
+    QDialog dialog(this);
+    dialog.setWindowTitle(tr("Batch Replace"));
+
+    QLabel fileLabel(tr("Rules file:"));
+    QLineEdit fileLineEdit;
+    fileLineEdit.setPlaceholderText(tr("One rule per line: pattern, a tab, replacement"));
+    QPushButton browseButton(tr("Browse..."));
+    QCheckBox caseCheck(tr("Match case"));
+    caseCheck.setChecked(true);
+    QCheckBox wordsCheck(tr("Whole words"));
+    QPushButton okButton(tr("Replace All"));
+    QPushButton cancelButton(tr("Cancel"));
+
+    QGridLayout layout;
+    layout.addWidget(&fileLabel, 0, 0);
+    layout.addWidget(&fileLineEdit, 0, 1);
+    layout.addWidget(&browseButton, 0, 2);
+    layout.addWidget(&caseCheck, 1, 0, 1, 3);
+    layout.addWidget(&wordsCheck, 2, 0, 1, 3);
+    layout.addWidget(&okButton, 3, 1);
+    layout.addWidget(&cancelButton, 3, 2);
+    dialog.setLayout(&layout);
+
+    connect(&browseButton, &QPushButton::clicked, &dialog, [&]() {
+        const QString fileName = QFileDialog::getOpenFileName(&dialog, tr("Rules File"), fileLineEdit.text(),
+                                                              tr("Rules (*.txt *.tsv);;All files (*)"));
+        if (!fileName.isEmpty())
+            fileLineEdit.setText(QDir::toNativeSeparators(fileName));
+    });
+    connect(&okButton, &QPushButton::clicked, &dialog, &QDialog::accept);
+    connect(&cancelButton, &QPushButton::clicked, &dialog, &QDialog::reject);
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    const QString fileName = QDir::fromNativeSeparators(fileLineEdit.text());
+    QVector<ReplaceRule> rules;
+    QString errorString;
+    if (!readReplaceRules(fileName, &rules, &errorString)) {
+        QMessageBox::warning(this, tr("Batch Replace"),
+                             tr("Cannot read rules file %1:\n%2.")
+                                     .arg(QDir::toNativeSeparators(fileName), errorString));
+        return;
+    }
+
+    // All the rules in one automaton, one scan off the GUI thread, then one edit
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    const std::shared_ptr<const ReplaceAutomaton> automaton = std::make_shared<ReplaceAutomaton>(
+            rules, caseCheck.isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive);
+    QFutureWatcher<BatchReplaceResult> watcher;
+    QEventLoop loop;
+    connect(&watcher, &QFutureWatcher<BatchReplaceResult>::finished, &loop, &QEventLoop::quit);
+    watcher.setFuture(startBatchReplace(textEdit->textBuffer(), automaton, wordsCheck.isChecked()));
+    // No input meanwhile, the positions must still hold when the replacements are made
+    if (!watcher.isFinished())
+        loop.exec(QEventLoop::ExcludeUserInputEvents);
+    QApplication::restoreOverrideCursor();
+    const BatchReplaceResult result = watcher.result();
+    // The report only comes once the replacements are in place as one undo step
+    if (!applyReplacements(result.matches))
+        return;
+
+    QStringList counts;
+    for (int i = 0; i < rules.size(); ++i)
+        counts.append(tr("%1 → %2: %n replacement(s)", nullptr, result.hits.at(i))
+                              .arg(rules.at(i).pattern, rules.at(i).replacement));
+    QMessageBox report(QMessageBox::Information, tr("Batch Replace"),
+                       tr("%n replacement(s)", nullptr, result.matches.size()) + QLatin1String(", ")
+                               + tr("%n rule(s)", nullptr, rules.size()),
+                       QMessageBox::Ok, this);
+    if (!result.matches.isEmpty())
+        report.setInformativeText(tr("Undo reverts all of them at once."));
+    report.setDetailedText(counts.join(QLatin1Char('\n')));
+    report.exec();
+}
+
+void MainWindow::createFindBar() {
+    findBar = new FindBar(this);
+    addToolBar(Qt::BottomToolBarArea, findBar);
+    findBar->hide();
+
+    searchWatcher = new QFutureWatcher<SearchResult>(this);
+    connect(searchWatcher, &QFutureWatcher<SearchResult>::finished, this, &MainWindow::findFinished);
+    connect(findBar, &FindBar::queryChanged, this, &MainWindow::startFind);
+    connect(findBar, &FindBar::findNext, this, &MainWindow::findNext);
+    connect(findBar, &FindBar::findPrevious, this, &MainWindow::findPrevious);
+    connect(findBar, &FindBar::closed, this, &MainWindow::findClosed);
+
+    // A search running during an edit is out of date: it starts again once typing pauses
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(200);
+    connect(searchTimer, &QTimer::timeout, this, &MainWindow::startFind);
+    // Large documents are indexed in the background, searches then only scan the candidate blocks
+    searchIndex = new TrigramIndex(&textEdit->textBuffer(), this);
+    connect(textEdit, &LineNumberTextEdit::textBufferChanged, this,
+            [this](int position, int charsRemoved, const QString &added) {
+        searchIndex->textChanged(position, charsRemoved, added.size());
+        updateFindMatches(position, charsRemoved, added.size());
+    });
+    // Replace-all, Batch Replace and their undo edit the buffer in one pass
+    reindexAfterBatch = false;
+    connect(textEdit, &LineNumberTextEdit::batchEditStarted, this, [this](int edits) {
+        reindexAfterBatch = edits > reindexReplacements;
+        if (reindexAfterBatch)
+            searchIndex->clear();
+        // The find bar searches again once, not around each replacement
+        if (findBar->isVisible())
+            searchTimer->start();
+    });
+    connect(textEdit, &LineNumberTextEdit::batchEditFinished, this, [this]() {
+        if (reindexAfterBatch)
+            rebuildSearchIndex();
+        reindexAfterBatch = false;
+    });
+    searchIndexLabel = new QLabel(this);
+    searchIndexLabel->hide();
+    statusBar()->addPermanentWidget(searchIndexLabel);
+    connect(searchIndex, &TrigramIndex::ready, this, &MainWindow::updateSearchIndexLabel);
+
+    // Scrolling brings other matches on screen
+    connect(textEdit->verticalScrollBar(), &QScrollBar::valueChanged, this, [this]() {
+        if (!searchResult.matches.isEmpty())
+            viewUpdates->schedule(currentLineTask);
+    });
+}
+
+void MainWindow::startFind() {
+    // The running search stops at its next window, its result is dropped
+    if (searchCancel)
+        searchCancel->storeRelease(1);
+    searchTimer->stop();
+
+    const SearchQuery query = findBar->query();
+    if (query.pattern.isEmpty()) {
+        searchResult = SearchResult();
+        findBar->setStatus(QString());
+        viewUpdates->schedule(currentLineTask);
+        return;
+    }
+    searchCancel = std::make_shared<QAtomicInt>(0);
+    findBar->setStatus(tr("Searching..."));
+    searchWatcher->setFuture(startSearch(textEdit->textBuffer(), query, searchCancel, searchIndex));
+}
+
+void MainWindow::findFinished() {
+    const SearchResult result = searchWatcher->result();
+    if (result.cancelled || result.query != findBar->query())
+        return;
+    searchResult = result;
+    updateFindStatus();
+    viewUpdates->schedule(currentLineTask);
+}
+
+void MainWindow::updateFindMatches(int position, int removed, int added) {
+    if (!findBar->isVisible())
+        return;
+    if (searchWatcher->isRunning() || searchTimer->isActive() || removed + added > localRescanLimit) {
+        searchTimer->start();
+        return;
+    }
+    if (searchResult.query.pattern.isEmpty())
+        return;
+    // The matches around the edit are searched again, the others only move
+    updateMatches(&searchResult, textEdit->textBuffer(), position, removed, added);
+    updateFindStatus();
+    viewUpdates->schedule(currentLineTask);
+}
+
+void MainWindow::updateFindStatus() {
+    const QVector<SearchMatch> &matches = searchResult.matches;
+    if (matches.isEmpty()) {
+        findBar->setStatus(tr("No matches"));
+        return;
+    }
+    // "n of total" while the selection is one of the matches
+    int start, end;
+    textEdit->selectionRange(&start, &end);
+    auto it = std::lower_bound(matches.begin(), matches.end(), start,
+                               [](const SearchMatch &match, int position) { return match.start < position; });
+    if (it != matches.end() && it->start == start && it->length == end - start)
+        findBar->setStatus(tr("%1 of %2").arg(it - matches.begin() + 1).arg(matches.size()));
+    else
+        findBar->setStatus(tr("%1 matches").arg(matches.size()));
+}
+
+void MainWindow::findNext() {
+    moveToMatch(true);
+}
+
+void MainWindow::findPrevious() {
+    moveToMatch(false);
+}
+
+void MainWindow::moveToMatch(bool forward) {
+    if (!findBar->isVisible()) {
+        findBar->activate();
+        return;
+    }
+    const QVector<SearchMatch> &matches = searchResult.matches;
+    if (matches.isEmpty())
+        return;
+
+    // Matches are sorted, the one after or before the selection wraps around the ends
+    int start, end;
+    textEdit->selectionRange(&start, &end);
+    int index;
+    if (forward) {
+        index = int(std::lower_bound(matches.begin(), matches.end(), end,
+                                     [](const SearchMatch &match, int position) { return match.start < position; })
+                    - matches.begin());
+        if (index == matches.size())
+            index = 0;
+    } else {
+        index = int(std::lower_bound(matches.begin(), matches.end(), start,
+                                     [](const SearchMatch &match, int position) { return match.start < position; })
+                    - matches.begin()) - 1;
+        if (index < 0)
+            index = matches.size() - 1;
+    }
+    textEdit->selectRange(matches.at(index).start, matches.at(index).length);
+    updateFindStatus();
+}
+
+void MainWindow::findClosed() {
+    if (searchCancel)
+        searchCancel->storeRelease(1);
+    searchTimer->stop();
+    searchResult = SearchResult();
+    viewUpdates->schedule(currentLineTask);
+    textEdit->setFocus();
+}
+
+void MainWindow::rebuildSearchIndex() {
+    if (indexSearchAct->isChecked() && textEdit->textBuffer().length() >= searchIndexThreshold)
+        searchIndex->build();
+    else
+        searchIndex->clear();
+    updateSearchIndexLabel();
+    // The matches belong to the previous document
+    if (findBar->isVisible())
+        startFind();
+}
+
+void MainWindow::updateSearchIndexLabel() {
+    searchIndexLabel->setVisible(searchIndex->isReady());
+    searchIndexLabel->setText(tr("Search index: %1 MB")
+                                      .arg(double(searchIndex->memoryUsage()) / (1024 * 1024), 0, 'f', 1));
+}
+
+void MainWindow::createFindInFilesDock() {
+    findInFilesDock = new QDockWidget(tr("Find in Files"), this);
+    findInFilesDock->setObjectName("findInFilesDock");
+    findInFilesPanel = new FindInFilesPanel(findInFilesDock);
+    findInFilesDock->setWidget(findInFilesPanel);
+    addDockWidget(Qt::BottomDockWidgetArea, findInFilesDock);
+    findInFilesDock->hide();
+    lineAfterLoad = -1;
+    connect(findInFilesPanel, &FindInFilesPanel::openRequested, this, &MainWindow::openFileAtLine);
+}
+
+void MainWindow::findInFiles() {
+    if (!curFile.isEmpty())
+        findInFilesPanel->setDirectory(QFileInfo(curFile).absolutePath());
+    findInFilesDock->show();
+    findInFilesDock->raise();
+    findInFilesPanel->activate();
+}
+
+void MainWindow::openFileAtLine(const QString &fileName, int line) {
+    // The current file is only moved in, it keeps its unsaved changes
+    if (QFileInfo(fileName) == QFileInfo(curFile) && !fileLoader->isLoading()) {
+        textEdit->goToLine(line - 1);
+        textEdit->setFocus();
+        return;
+    }
+    if (!maybeSave())
+        return;
+    fileLoader->cancel();
+    lineAfterLoad = line - 1;
+    loadFile(fileName);
+}
+
+void MainWindow::goToLine() {
+    bool ok;
+    const int line = QInputDialog::getInt(this, tr("Go to Line"), tr("Line:"), textEdit->currentLine() + 1,
+                                          1, textEdit->lineCount(), 1, &ok);
+    if (ok)
+        textEdit->goToLine(line - 1);
 }
 
 void MainWindow::searchAndReplace() {
@@ -550,6 +1305,9 @@ void MainWindow::searchAndReplace() {
     QPushButton okButton(tr("OK"));
     QPushButton cancelButton(tr("Cancel"));
     QPushButton toggleModeButton(tr("Toggle Mode: Word"));
+    QCheckBox regexCheck(tr("Regular expression (\\1 in the replacement inserts group 1)"));
+    QListWidget previewList;
+    QLabel previewLabel;
     bool findWholeWords = true;
 
     QGridLayout layout;
@@ -560,64 +1318,136 @@ void MainWindow::searchAndReplace() {
     layout.addWidget(&okButton, 2, 0);
     layout.addWidget(&cancelButton, 2, 1);
     layout.addWidget(&toggleModeButton, 3, 0, 1, 2);
+    layout.addWidget(&regexCheck, 4, 0, 1, 2);
+    layout.addWidget(&previewLabel, 5, 0, 1, 2);
+    layout.addWidget(&previewList, 6, 0, 1, 2);
     dialog.setLayout(&layout);
 
+    // The first replacements are previewed as the fields change, on a snapshot in the background
+    SearchCancel previewCancel;
+    QFutureWatcher<ReplaceScan> previewWatcher;
+    QTimer previewTimer;
+    previewTimer.setSingleShot(true);
+    previewTimer.setInterval(300);
+    QTimer previewTimeout;
+    previewTimeout.setSingleShot(true);
+    previewTimeout.setInterval(matchTimeoutMs);
+    auto updatePreview = [&]() {
+        if (previewCancel)
+            previewCancel->storeRelease(1);
+        previewTimeout.stop();
+        previewList.clear();
+        const QString search = searchLineEdit.text();
+        if (search.isEmpty()) {
+            previewLabel.clear();
+            return;
+        }
+        previewCancel = std::make_shared<QAtomicInt>(0);
+        QString errorString;
+        const QFuture<ReplaceScan> scan = startReplacements(textEdit->textBuffer(), search, replaceLineEdit.text(),
+                                                            findWholeWords, regexCheck.isChecked(),
+                                                            previewedReplacements, previewCancel, &errorString);
+        if (!errorString.isEmpty()) {
+            previewLabel.setText(tr("Invalid regular expression: %1").arg(errorString));
+            return;
+        }
+        previewLabel.setText(tr("Searching..."));
+        previewWatcher.setFuture(scan);
+        previewTimeout.start();
+    };
+    connect(&previewWatcher, &QFutureWatcher<ReplaceScan>::finished, &dialog, [&]() {
+        const ReplaceScan scan = previewWatcher.result();
+        if (scan.cancelled)
+            return;
+        previewTimeout.stop();
+        const PieceTable &buffer = textEdit->textBuffer();
+        for (const ReplaceMatch &match : scan.matches) {
+            QString found = buffer.text(match.start, qMin(match.length, 60));
+            QString replacement = match.replacement.left(60);
+            found.replace(QLatin1Char('\n'), QLatin1String("\\n"));
+            replacement.replace(QLatin1Char('\n'), QLatin1String("\\n"));
+            previewList.addItem(tr("Line %1: %2 → %3").arg(buffer.lineAt(match.start) + 1).arg(found, replacement));
+        }
+        previewLabel.setText(scan.matches.isEmpty() ? tr("No match")
+                                                    : tr("First %n replacement(s):", nullptr, scan.matches.size()));
+    });
+    connect(&previewTimeout, &QTimer::timeout, &dialog, [&]() {
+        previewCancel->storeRelease(1);
+        previewLabel.setText(tr("The pattern took too long and was cancelled"));
+    });
+    connect(&previewTimer, &QTimer::timeout, &dialog, updatePreview);
+    connect(&searchLineEdit, &QLineEdit::textChanged, &previewTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(&replaceLineEdit, &QLineEdit::textChanged, &previewTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(&regexCheck, &QCheckBox::toggled, &dialog, updatePreview);
+
     connect(&okButton, &QPushButton::clicked, &dialog, &QDialog::accept);
+    connect(&cancelButton, &QPushButton::clicked, &dialog, &QDialog::reject);
     connect(&toggleModeButton, &QPushButton::clicked, [&]() {
         findWholeWords = !findWholeWords;
         toggleModeButton.setText(findWholeWords ? tr("Toggle Mode: Word") : tr("Toggle Mode: Letter"));
+        updatePreview();
     });
 
-    if (dialog.exec() == QDialog::Accepted) {
+    const int result = dialog.exec();
+    if (previewCancel)
+        previewCancel->storeRelease(1);
+    if (result == QDialog::Accepted) {
         QString search = searchLineEdit.text();
         QString replace = replaceLineEdit.text();
-        searchReplaceFunction(search, replace, findWholeWords);
+        searchReplaceFunction(search, replace, findWholeWords, regexCheck.isChecked());
     }
 }
 
 QStringList MainWindow::getSpellingSuggestions(const QString &word) {
-    QStringList suggestions;
-
-    if (spellChecker.spell(word.toStdString())) {
-        return suggestions;
-    }
-
-    std::vector<std::string> hunspellSuggestions = spellChecker.suggest(word.toStdString());
-    for (const std::string &suggestion : hunspellSuggestions) {
-        suggestions.append(QString::fromStdString(suggestion));
-    }
-
-    return suggestions;
+    return spellCache.suggestions(word);
 }
 
 void MainWindow::checkSpelling() {
-    QTextCursor cursor = textEdit->textCursor();
-    cursor.movePosition(QTextCursor::Start);
+    // The next misspelled word after the cursor is selected, with its suggestions in a menu
+    const QTextCursor current = textEdit->textCursor();
+    QTextBlock block = textEdit->document()->findBlock(current.selectionEnd());
+    int from = current.selectionEnd() - block.position();
+    for (; block.isValid(); block = block.next(), from = 0) {
+        const QString text = block.text();
+        // A cursor inside a word goes on after it
+        while (from > 0 && from < text.size() && text.at(from - 1).isLetter() && text.at(from).isLetter())
+            ++from;
+        int start = 0;
+        int length;
+        for (; (length = SpellHighlighter::nextWord(text, from, &start)) > 0; from = start + length) {
+            if (!spellHighlighter->isMisspelled(text.mid(start, length)))
+                continue;
+
+            QTextCursor cursor(block);
+            cursor.setPosition(block.position() + start);
+            cursor.setPosition(block.position() + start + length, QTextCursor::KeepAnchor);
+            textEdit->setTextCursor(cursor);
+            textEdit->ensureCursorVisible();
 
-    while (!cursor.atEnd()) {
-        cursor.select(QTextCursor::WordUnderCursor);
-        QString word = cursor.selectedText();
-        QStringList suggestions = getSpellingSuggestions(word);
-
-        if (!suggestions.isEmpty()) {
-            // Show suggestions in a custom context menu
             QMenu contextMenu;
-            contextMenu.setTitle("Spelling Suggestions");
-
+            contextMenu.setTitle(tr("Spelling Suggestions"));
+            const QString word = cursor.selectedText();
+            const QStringList suggestions = getSpellingSuggestions(word);
             for (const QString &suggestion : suggestions) {
                 QAction *action = contextMenu.addAction(suggestion);
                 action->setData(suggestion);
                 connect(action, &QAction::triggered, this, &MainWindow::replaceMisspelledWordWithSuggestion);
             }
+            if (suggestions.isEmpty())
+                contextMenu.addAction(tr("No suggestions"))->setEnabled(false);
+            contextMenu.addSeparator();
+            connect(contextMenu.addAction(tr("Add to Dictionary")), &QAction::triggered, this, [this, word]() {
+                spellCache.addWord(word);
+                spellHighlighter->dictionaryChanged();
+            });
 
             // Show the context menu at the cursor position
             QPoint cursorPos = textEdit->mapToGlobal(textEdit->cursorRect().bottomRight());
             contextMenu.exec(cursorPos);
+            return;
         }
-
-        cursor.clearSelection();
-        cursor.movePosition(QTextCursor::NextWord);
     }
+    statusBar()->showMessage(tr("No misspelled words after the cursor"), 2000);
 }
 
 void MainWindow::replaceMisspelledWordWithSuggestion() {
@@ -631,12 +1461,12 @@ void MainWindow::replaceMisspelledWordWithSuggestion() {
 
 void MainWindow::undo()
 {
-    textEdit->undo();
+    textEdit->undoEdit();
 }
 
 void MainWindow::redo()
 {
-    textEdit->redo();
+    textEdit->redoEdit();
 }
 
 void MainWindow::changeTheme(int index) {
@@ -690,6 +1520,22 @@ void MainWindow::highlightCurrentLine() {
         extraSelections.append(selection);
     }
 
+    // Find bar matches on screen, looked up in the sorted list by the visible range
+    const QVector<SearchMatch> &matches = searchResult.matches;
+    if (!matches.isEmpty()) {
+        int start, end;
+        textEdit->visibleRange(&start, &end);
+        QTextEdit::ExtraSelection hit;
+        hit.format.setBackground(QColor(255, 220, 100));
+        auto it = std::lower_bound(matches.begin(), matches.end(), start,
+                                   [](const SearchMatch &match, int position) { return match.start + match.length <= position; });
+        for (; it != matches.end() && it->start < end; ++it) {
+            hit.cursor = textEdit->cursorForRange(it->start, it->length);
+            if (!hit.cursor.isNull())
+                extraSelections.append(hit);
+        }
+    }
+
     textEdit->setExtraSelections(extraSelections);
 }
 
@@ -698,11 +1544,6 @@ void MainWindow::onScrollBarValueChanged()
     textEdit->updateLineNumberArea(textEdit->viewport()->rect(), 0);
 }
 
-void MainWindow::updateLineNumberAreaWidth() {
-    int width = lineNumberAreaWidth();
-    textEdit->setViewportMarginsPublic(width, 0, 0, 0);
-}
-
 void MainWindow::resizeEvent(QResizeEvent *event) {
     QMainWindow::resizeEvent(event);
     QRect cr = contentsRect();
@@ -711,7 +1552,7 @@ void MainWindow::resizeEvent(QResizeEvent *event) {
 
 int MainWindow::lineNumberAreaWidth() {
     int digits = 1;
-    int max = qMax(1, textEdit->document()->blockCount());
+    int max = qMax(1, textEdit->lineCount());
     while (max >= 10) {
         max /= 10;
         ++digits;
@@ -886,7 +1727,7 @@ void MainWindow::showCommentDialog(const QString &comment) {
 
 void MainWindow::addComment()
 {
-    int lineNumber = textEdit->textCursor().blockNumber();
+    int lineNumber = textEdit->currentLine();
     QString comment = QInputDialog::getText(this, tr("Add Comment"), tr("Comment:"), QLineEdit::Normal);
     if (!comment.isEmpty()) {
         textEdit->addComment(lineNumber, comment);
@@ -896,7 +1737,7 @@ void MainWindow::addComment()
 
 void MainWindow::editComment()
 {
-    int lineNumber = textEdit->textCursor().blockNumber();
+    int lineNumber = textEdit->currentLine();
     QString initialComment = textEdit->getComment(lineNumber);
     bool ok;
     QString comment = QInputDialog::getText(this, tr("Edit Comment"), tr("Comment:"), QLineEdit::Normal, initialComment, &ok);
@@ -912,7 +1753,7 @@ void MainWindow::editComment()
 
 void MainWindow::showCommentFromAction()
 {
-    int lineNumber = textEdit->textCursor().blockNumber();
+    int lineNumber = textEdit->currentLine();
     QString comment = textEdit->getComment(lineNumber);
     showComment(comment);
 }
@@ -925,15 +1766,14 @@ void MainWindow::showComment(const QString &comment)
 
 void MainWindow::removeComment()
 {
-    int lineNumber = textEdit->textCursor().blockNumber();
+    int lineNumber = textEdit->currentLine();
     textEdit->removeComment(lineNumber);
     updateCommentActions();
 }
 
 void MainWindow::updateCommentActions()
 {
-    QTextCursor cursor = textEdit->textCursor();
-    int lineNumber = cursor.blockNumber();
+    int lineNumber = textEdit->currentLine();
     bool hasComment = textEdit->hasComment(lineNumber);
     addCommentAction->setDisabled(hasComment);
     editCommentAction->setEnabled(hasComment);
@@ -982,6 +1822,11 @@ void MainWindow::createActions() {
     saveAsAct->setShortcuts(QKeySequence::SaveAs);
     saveAsAct->setStatusTip(tr("Save the document under a new name"));
 
+    cancelLoadAct = fileMenu->addAction(tr("&Cancel Loading"), this, &MainWindow::cancelLoad);
+    cancelLoadAct->setShortcut(QKeySequence::Cancel);
+    cancelLoadAct->setStatusTip(tr("Stop loading the current file"));
+    cancelLoadAct->setEnabled(false);
+
     fileMenu->addSeparator();
 
     // Create the theme actions
@@ -1208,18 +2053,58 @@ void MainWindow::createActions() {
     searchAndReplaceAct->setStatusTip(tr("Search and replace text"));
     connect(searchAndReplaceAct, &QAction::triggered, this, &MainWindow::searchAndReplace);
     editMenu->addAction(searchAndReplaceAct);
+
+    QAction *batchReplaceAct = new QAction(tr("&Batch Replace..."), this);
+    batchReplaceAct->setStatusTip(tr("Apply a file of search and replace rules in one step"));
+    connect(batchReplaceAct, &QAction::triggered, this, &MainWindow::batchReplace);
+    editMenu->addAction(batchReplaceAct);
     editToolBar->addAction(searchAndReplaceAct);
 
+    // FIND
+    QAction *findAct = new QAction(tr("&Find..."), this);
+    findAct->setShortcuts(QKeySequence::Find);
+    findAct->setStatusTip(tr("Search the text as you type"));
+    connect(findAct, &QAction::triggered, findBar, &FindBar::activate);
+    editMenu->addAction(findAct);
+
+    QAction *findNextAct = new QAction(tr("Find &Next"), this);
+    findNextAct->setShortcuts(QKeySequence::FindNext);
+    connect(findNextAct, &QAction::triggered, this, &MainWindow::findNext);
+    editMenu->addAction(findNextAct);
+
+    QAction *findPreviousAct = new QAction(tr("Find Pre&vious"), this);
+    findPreviousAct->setShortcuts(QKeySequence::FindPrevious);
+    connect(findPreviousAct, &QAction::triggered, this, &MainWindow::findPrevious);
+    editMenu->addAction(findPreviousAct);
+
+    QAction *findInFilesAct = new QAction(tr("Find in Fi&les..."), this);
+    findInFilesAct->setShortcut(QKeySequence(tr("Ctrl+Shift+F")));
+    findInFilesAct->setStatusTip(tr("Search every file of a folder"));
+    connect(findInFilesAct, &QAction::triggered, this, &MainWindow::findInFiles);
+    editMenu->addAction(findInFilesAct);
+
+    // GO TO LINE
+    QAction *goToLineAct = new QAction(tr("&Go to Line..."), this);
+    goToLineAct->setShortcut(QKeySequence(tr("Ctrl+G")));
+    goToLineAct->setStatusTip(tr("Move the cursor to a line number"));
+    connect(goToLineAct, &QAction::triggered, this, &MainWindow::goToLine);
+    editMenu->addAction(goToLineAct);
+
     editMenu->addSeparator();
 
     // SPELLING
     const QIcon spellingIcon =  QIcon(":/images/spelling.png");
     QAction *checkSpellingAction = new QAction(spellingIcon, tr("Check Spelling"), this);
     checkSpellingAction->setShortcut(QKeySequence(tr("Ctrl+Shift+S")));
-    checkSpellingAction->setStatusTip(tr("Check spelling"));
+    checkSpellingAction->setStatusTip(tr("Select the next misspelled word and show its suggestions"));
     connect(checkSpellingAction, &QAction::triggered, this, &MainWindow::checkSpelling);
     // Add the action to a menu
     editMenu->addAction(checkSpellingAction);
+    spellAsYouTypeAct = editMenu->addAction(tr("Check Spelling as You &Type"));
+    spellAsYouTypeAct->setCheckable(true);
+    spellAsYouTypeAct->setChecked(true);
+    spellAsYouTypeAct->setStatusTip(tr("Underline misspelled words while editing"));
+    connect(spellAsYouTypeAct, &QAction::toggled, spellHighlighter, &SpellHighlighter::setEnabled);
 
     /* Insert menu and toolbar */
     QMenu *insertMenu = menuBar()->addMenu(tr("&Insert"));
@@ -1282,6 +2167,19 @@ void MainWindow::createActions() {
 
 #endif // !QT_NO_CLIPBOARD
 
+    QMenu *viewMenu = menuBar()->addMenu(tr("&View"));
+    QAction *statisticsAct = statisticsDock->toggleViewAction();
+    statisticsAct->setStatusTip(tr("Show sentence, paragraph and vocabulary statistics"));
+    viewMenu->addAction(statisticsAct);
+    QAction *findInFilesViewAct = findInFilesDock->toggleViewAction();
+    findInFilesViewAct->setStatusTip(tr("Show the results of the last search in files"));
+    viewMenu->addAction(findInFilesViewAct);
+    indexSearchAct = viewMenu->addAction(tr("&Index Large Documents for Search"));
+    indexSearchAct->setCheckable(true);
+    indexSearchAct->setChecked(true);
+    indexSearchAct->setStatusTip(tr("Keep a trigram index of documents over 1 MB so that searches skip most of the text"));
+    connect(indexSearchAct, &QAction::toggled, this, &MainWindow::rebuildSearchIndex);
+
     QMenu *helpMenu = menuBar()->addMenu(tr("&Help"));
     QAction *aboutAct = helpMenu->addAction(tr("&About"), this, &MainWindow::about);
     aboutAct->setStatusTip(tr("Show the application's About box"));
@@ -4,7 +4,23 @@
 #include <QSessionManager>
 #include <QLabel>
 #include <QActionGroup>
+#include <QFutureWatcher>
 #include "linenumbertextedit.hpp"
+#include "textencoding.hpp"
+#include "textsearch.hpp"
+
+class FileLoader;
+class FileSaver;
+class EditJournal;
+class UpdateScheduler;
+class QDockWidget;
+class FindBar;
+class TrigramIndex;
+class FindInFilesPanel;
+class SpellHighlighter;
+struct DocumentStatistics;
+struct JournalReplay;
+struct ReplaceMatch;
 
 class MainWindow : public QMainWindow
 {
@@ -14,6 +30,7 @@ public:
     MainWindow();
 
     void loadFile(const QString &fileName);
+    bool restoreFromJournal();
     void undo();
     void redo();
     int lineNumberAreaWidth();
@@ -36,6 +53,7 @@ private slots:
     void superscript();
     void subscript();
     void autoSave();
+    void compactJournal();
     void increaseFontSize();
     void decreaseFontSize();
     void uppercase();
@@ -45,8 +63,11 @@ private slots:
     void checkSpelling();
     void changeTheme(int index);
     void showThemeMenu();
-    void searchReplaceFunction(const QString &search, const QString &replace, bool findWholeWords);
+    void searchReplaceFunction(const QString &search, const QString &replace, bool findWholeWords,
+                               bool regexMode = false);
     void searchAndReplace();
+    void batchReplace();
+    void goToLine();
     void onScrollBarValueChanged();
     void setColorSelectedText(const QColor &color);
     void setFontText(const QFont &font);
@@ -61,6 +82,19 @@ private slots:
     void showCommentFromAction();
     void showComment(const QString &comment);
     void removeComment();
+    void loadProgress(qint64 bytesLoaded, qint64 totalBytes, qint64 linesLoaded);
+    void loadFinished(bool completed);
+    void cancelLoad();
+    void saveFinished(const QString &fileName, bool ok, const QString &errorString);
+    void updateStatistics();
+    void statisticsFinished();
+    void startFind();
+    void findFinished();
+    void findNext();
+    void findPrevious();
+    void findClosed();
+    void findInFiles();
+    void openFileAtLine(const QString &fileName, int line);
 
 #ifndef QT_NO_SESSIONMANAGER
     void commitData(QSessionManager &);
@@ -72,10 +106,30 @@ private:
     void readSettings();
     void writeSettings();
     bool maybeSave();
+    /* Chargement synchrone du format natif (.oad), avec formats, images et commentaires */
+    void loadNativeFile(const QString &fileName);
+    /* Document rejoué depuis un journal orphelin, repris comme journal de cette fenêtre */
+    void restoreReplay(const QString &journalFile, const JournalReplay &replay);
     bool saveFile(const QString &fileName);
     void setCurrentFile(const QString &fileName);
     void updateCounts();
-    void updateLineNumberAreaWidth();
+    int selectionWordStarts(int start, int end);
+    /* Panneau Statistiques, calculé en parallèle hors du thread graphique */
+    void createStatisticsDock();
+    /* Barre de recherche : recherche sur un instantané en arrière-plan, occurrences visibles surlignées */
+    void createFindBar();
+    void moveToMatch(bool forward);
+    /* Occurrences corrigées autour d'une modification, sans tout rechercher à nouveau */
+    void updateFindMatches(int position, int removed, int added);
+    void updateFindStatus();
+    /* Index de recherche refait pour le document chargé, ou abandonné sous le seuil */
+    void rebuildSearchIndex();
+    void updateSearchIndexLabel();
+    /* Remplacements triés, appliqués en une seule modification annulable, aussi en mode
+       grand fichier. Faux si rien n'a été remplacé */
+    bool applyReplacements(const QVector<ReplaceMatch> &matches);
+    /* Panneau Rechercher dans les fichiers, une occurrence cliquée ouvre son fichier */
+    void createFindInFilesDock();
     void highlightCurrentLine();
     void createZoomInAndZoomOut();
 
@@ -88,11 +142,47 @@ private:
     QString strippedName(const QString &fullFileName);
 
     QString curFile;
+    /* Encodage et fins de ligne du fichier courant, rendus à l'enregistrement */
+    TextFileFormat fileFormat;
 
     QTimer *autoSaveTimer;
+    FileLoader *fileLoader;
+    FileSaver *fileSaver;
+    EditJournal *journal;
+    QAction *cancelLoadAct;
+    bool loadingLargeFile;
     QLabel *wordCountLabel;
     QLabel *charCountLabel;
     QLabel *lineCountLabel;
+    UpdateScheduler *viewUpdates;
+    int countsTask;
+    int currentLineTask;
+    /* Dernière sélection comptée et ses débuts de mots, -1 après une modification du texte */
+    int countedStart;
+    int countedEnd;
+    int countedWords;
+    QDockWidget *statisticsDock;
+    QLabel *statisticsLabel;
+    QFutureWatcher<DocumentStatistics> *statisticsWatcher;
+    QTimer *statisticsTimer;
+    bool statisticsStale;
+    FindBar *findBar;
+    QFutureWatcher<SearchResult> *searchWatcher;
+    SearchCancel searchCancel;
+    /* Dernier résultat complet de la requête affichée */
+    SearchResult searchResult;
+    QTimer *searchTimer;
+    TrigramIndex *searchIndex;
+    /* L'index est reconstruit à la fin du remplacement groupé en cours */
+    bool reindexAfterBatch;
+    QLabel *searchIndexLabel;
+    QAction *indexSearchAct;
+    QDockWidget *findInFilesDock;
+    FindInFilesPanel *findInFilesPanel;
+    /* Ligne où placer le curseur quand le chargement en cours se termine, -1 sinon */
+    int lineAfterLoad;
+    SpellHighlighter *spellHighlighter;
+    QAction *spellAsYouTypeAct;
 
     LineNumberTextEdit *textEdit;
     QWidget *lineNumberArea;
@@ -0,0 +1,89 @@
+#include "wordcount.hpp"
+#include "cpufeatures.hpp"
+#ifdef OA_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static int countWordStartsScalar(const ushort *p, const ushort *end, bool *space)
+{
+    int count = 0;
+    bool previous = *space;
+    for (; p < end; ++p) {
+        const bool isSpace = isAsciiSpace(*p);
+        count += previous && !isSpace;
+        previous = isSpace;
+    }
+    *space = previous;
+    return count;
+}
+
+#ifdef OA_X86_SIMD
+
+/* The masks hold two bits per character, as _mm_movemask_epi8 leaves them: a word
+   starts where a non-space bit pair follows a space pair, the previous block's last
+   pair included. Every start is then counted twice. Only ASCII whitespace is space,
+   so surrogates and other non-ASCII units need no special case. */
+
+static int countWordStartsSse2(const ushort *p, const ushort *end, bool *space)
+{
+    const __m128i blank = _mm_set1_epi16(' ');
+    const __m128i tab = _mm_set1_epi16('\t');
+    const __m128i controlRange = _mm_set1_epi16('\r' - '\t');
+    quint32 carry = *space ? 3 : 0;
+    int doubled = 0;
+    for (; end - p >= 8; p += 8) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        // c - '\t' <= '\r' - '\t' unsigned, with a saturating subtraction
+        const __m128i control = _mm_cmpeq_epi16(_mm_subs_epu16(_mm_sub_epi16(chars, tab), controlRange),
+                                                _mm_setzero_si128());
+        const __m128i spaces = _mm_or_si128(control, _mm_cmpeq_epi16(chars, blank));
+        const quint32 mask = quint32(_mm_movemask_epi8(spaces));
+        doubled += qPopulationCount(~mask & ((mask << 2) | carry) & 0xffff);
+        carry = mask >> 14;
+    }
+    *space = carry != 0;
+    return doubled / 2 + countWordStartsScalar(p, end, space);
+}
+
+OA_TARGET_AVX2 static int countWordStartsAvx2(const ushort *p, const ushort *end, bool *space)
+{
+    const __m256i blank = _mm256_set1_epi16(' ');
+    const __m256i tab = _mm256_set1_epi16('\t');
+    const __m256i controlRange = _mm256_set1_epi16('\r' - '\t');
+    quint64 carry = *space ? 3 : 0;
+    int doubled = 0;
+    for (; end - p >= 32; p += 32) {
+        const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 16));
+        const __m256i lowSpaces = _mm256_or_si256(
+                _mm256_cmpeq_epi16(_mm256_min_epu16(_mm256_sub_epi16(low, tab), controlRange),
+                                   _mm256_sub_epi16(low, tab)),
+                _mm256_cmpeq_epi16(low, blank));
+        const __m256i highSpaces = _mm256_or_si256(
+                _mm256_cmpeq_epi16(_mm256_min_epu16(_mm256_sub_epi16(high, tab), controlRange),
+                                   _mm256_sub_epi16(high, tab)),
+                _mm256_cmpeq_epi16(high, blank));
+        const quint64 mask = quint64(quint32(_mm256_movemask_epi8(lowSpaces)))
+                             | quint64(quint32(_mm256_movemask_epi8(highSpaces))) << 32;
+        doubled += qPopulationCount(~mask & ((mask << 2) | carry));
+        carry = mask >> 62;
+    }
+    *space = carry != 0;
+    return doubled / 2 + countWordStartsSse2(p, end, space);
+}
+
+#endif
+
+int countWordStarts(const QChar *data, int length, bool previousIsSpace)
+{
+    const ushort *p = reinterpret_cast<const ushort *>(data);
+    const ushort *end = p + length;
+    bool space = previousIsSpace;
+#ifdef OA_X86_SIMD
+    if (cpuHasAvx2())
+        return countWordStartsAvx2(p, end, &space);
+    return countWordStartsSse2(p, end, &space);
+#else
+    return countWordStartsScalar(p, end, &space);
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef WORDCOUNT_HPP
+#define WORDCOUNT_HPP
+
+#include <QChar>
+
+/* Débuts de mots dans data[0, length) : caractères hors blancs ASCII (espace, \t à \r)
+   qui suivent un blanc. previousIsSpace indique si le caractère avant data en est un.
+   Vectorisé (AVX2 si disponible, sinon SSE2) */
+int countWordStarts(const QChar *data, int length, bool previousIsSpace);
+
+inline bool isAsciiSpace(ushort c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+#endif